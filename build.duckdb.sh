@@ -1,8 +1,23 @@
 #!/bin/bash
 set -e
+ROOT="$(pwd)"
 if [ ! -d "ext/duckdb-1.4.3" ]; then
   git clone --depth 1 --branch v1.4.3 https://github.com/duckdb/duckdb.git ext/duckdb-1.4.3
 fi
+
+# spatial extension, linked statically (extension_config.cmake); its GEOS, PROJ and GDAL
+# dependencies are built by vcpkg from the extension's manifest
+if [ ! -d "ext/duckdb-spatial" ]; then
+  git clone --depth 1 --branch v1.4-andium --recurse-submodules https://github.com/duckdb/duckdb-spatial.git ext/duckdb-spatial
+fi
+if [ ! -d "ext/vcpkg" ]; then
+  git clone https://github.com/microsoft/vcpkg.git ext/vcpkg
+  if [[ "$OSTYPE" == "msys" ]]; then
+    ./ext/vcpkg/bootstrap-vcpkg.bat -disableMetrics
+  else
+    ./ext/vcpkg/bootstrap-vcpkg.sh -disableMetrics
+  fi
+fi
 mkdir -p build/duckdb-1.4.3
 pushd build
 pushd duckdb-1.4.3
@@ -14,22 +29,26 @@ DUCKDB_OPTS="\
 -DBUILD_EXTENSIONS='' \
 -DENABLE_SANITIZER=OFF \
 -DENABLE_UBSAN=OFF \
--DBUILD_BENCHMARKS=OFF"
+-DBUILD_BENCHMARKS=OFF \
+-DDUCKDB_EXTENSION_CONFIGS=$ROOT/extension_config.cmake \
+-DCMAKE_TOOLCHAIN_FILE=$ROOT/ext/vcpkg/scripts/buildsystems/vcpkg.cmake \
+-DVCPKG_MANIFEST_DIR=$ROOT/ext/duckdb-spatial \
+-DVCPKG_BUILD=1"
 
 if [[ "$OSTYPE" == "msys" ]]; then
 
-cmake ../../ext/duckdb-1.4.3 -G "Visual Studio 18 2026" -A x64 $DUCKDB_OPTS
-cmake --build . --config RelWithDebInfo --target duckdb_static
+cmake ../../ext/duckdb-1.4.3 -G "Visual Studio 18 2026" -A x64 $DUCKDB_OPTS -DVCPKG_TARGET_TRIPLET=x64-windows-static-md
+cmake --build . --config RelWithDebInfo --target duckdb_static spatial_extension
 
 elif [[ "$OSTYPE" == "darwin"* ]]; then
 
 cmake ../../ext/duckdb-1.4.3 $DUCKDB_OPTS
-cmake --build . --config Release --parallel --target duckdb_static
+cmake --build . --config Release --parallel --target duckdb_static spatial_extension
 
 elif [[ "$OSTYPE" == "linux-gnu"* ]]; then
 
 cmake ../../ext/duckdb-1.4.3 $DUCKDB_OPTS
-cmake --build . --config Release -j1 --target duckdb_static
+cmake --build . --config Release -j1 --target duckdb_static spatial_extension
 
 fi
 
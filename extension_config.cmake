@@ -0,0 +1,7 @@
+# DuckDB extensions built into the static library by build.duckdb.sh (DUCKDB_EXTENSION_CONFIGS).
+# spatial is linked into loader and elections and loaded in-process, see load_spatial
+
+duckdb_extension_load(spatial
+  SOURCE_DIR ${CMAKE_CURRENT_LIST_DIR}/ext/duckdb-spatial
+  INCLUDE_DIR ${CMAKE_CURRENT_LIST_DIR}/ext/duckdb-spatial/src/spatial
+)
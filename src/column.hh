@@ -0,0 +1,91 @@
+#ifndef ELECTIONS_COLUMN_HH
+#define ELECTIONS_COLUMN_HH
+
+#include "duckdb.hpp"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// column_t
+// typed view of one vector of a flattened DataChunk: reads the FlatVector data and validity mask
+// directly instead of boxing every cell into a duckdb::Value. T must match the physical type of
+// the column, see has_types
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+class column_t
+{
+public:
+  explicit column_t(duckdb::Vector& vector)
+    : data(duckdb::FlatVector::GetData<T>(vector)), validity(duckdb::FlatVector::Validity(vector))
+  {
+  }
+
+  bool valid(size_t idx) const
+  {
+    return validity.RowIsValid(idx);
+  }
+
+  T get(size_t idx, T null_value = T()) const
+  {
+    return validity.RowIsValid(idx) ? data[idx] : null_value;
+  }
+
+private:
+  const T* data;
+  const duckdb::ValidityMask& validity;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// string_column_t
+// VARCHAR column; strings are copied once from the string_t, NULL is the empty string
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class string_column_t
+{
+public:
+  explicit string_column_t(duckdb::Vector& vector)
+    : data(duckdb::FlatVector::GetData<duckdb::string_t>(vector)), validity(duckdb::FlatVector::Validity(vector))
+  {
+  }
+
+  void get(size_t idx, std::string& str) const
+  {
+    if (validity.RowIsValid(idx))
+    {
+      str.assign(data[idx].GetData(), data[idx].GetSize());
+    }
+    else
+    {
+      str.clear();
+    }
+  }
+
+private:
+  const duckdb::string_t* data;
+  const duckdb::ValidityMask& validity;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// has_types
+// true when the result columns have exactly these physical types; otherwise the caller keeps
+// the duckdb::Value path, which converts
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline bool has_types(const duckdb::QueryResult& result, const std::vector<duckdb::PhysicalType>& types)
+{
+  if (result.types.size() != types.size())
+  {
+    return false;
+  }
+  for (size_t idx = 0; idx < types.size(); idx++)
+  {
+    if (result.types[idx].InternalType() != types[idx])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "compress.hh"
+#include <cstring>
+#include <cstdint>
+#include "miniz.hpp"
+#include "zstd.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// crc32_update
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned long crc32_update(unsigned long crc, const void* data, size_t size)
+{
+  return duckdb_miniz::mz_crc32(crc, static_cast<const unsigned char*>(data), size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// deflate_append
+// one-shot deflate of data appended to out; negative window bits write a raw stream, positive a
+// zlib stream (2 byte header, Adler-32 trailer)
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool deflate_append(std::string& out, const std::string& data, int level, int window_bits)
+{
+  duckdb_miniz::mz_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (duckdb_miniz::mz_deflateInit2(&stream, level, duckdb_miniz::MZ_DEFLATED,
+    window_bits, 9, duckdb_miniz::MZ_DEFAULT_STRATEGY) != duckdb_miniz::MZ_OK)
+  {
+    return false;
+  }
+
+  size_t offset = out.size();
+  size_t bound = duckdb_miniz::mz_deflateBound(&stream, static_cast<duckdb_miniz::mz_ulong>(data.size()));
+  out.resize(offset + bound);
+
+  stream.next_in = reinterpret_cast<const unsigned char*>(data.data());
+  stream.avail_in = static_cast<unsigned int>(data.size());
+  stream.next_out = reinterpret_cast<unsigned char*>(&out[offset]);
+  stream.avail_out = static_cast<unsigned int>(bound);
+  int status = duckdb_miniz::mz_deflate(&stream, duckdb_miniz::MZ_FINISH);
+  size_t written = static_cast<size_t>(stream.total_out);
+  duckdb_miniz::mz_deflateEnd(&stream);
+  if (status != duckdb_miniz::MZ_STREAM_END)
+  {
+    return false;
+  }
+  out.resize(offset + written);
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// gzip_compress
+// RFC 1952 member: 10 byte header, raw deflate stream, CRC-32 and size trailer
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string gzip_compress(const std::string& data, int level)
+{
+  static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 0xff };
+  std::string out(reinterpret_cast<const char*>(header), sizeof(header));
+  if (!deflate_append(out, data, level, -duckdb_miniz::MZ_DEFAULT_WINDOW_BITS))
+  {
+    return std::string();
+  }
+
+  unsigned long crc = crc32_update(MZ_CRC32_INIT, data.data(), data.size());
+  uint32_t size = static_cast<uint32_t>(data.size());
+  for (int idx = 0; idx < 4; idx++)
+  {
+    out.push_back(static_cast<char>((crc >> (8 * idx)) & 0xff));
+  }
+  for (int idx = 0; idx < 4; idx++)
+  {
+    out.push_back(static_cast<char>((size >> (8 * idx)) & 0xff));
+  }
+  return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// zlib_compress
+// RFC 1950 stream, as stored in PNG IDAT chunks
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string zlib_compress(const std::string& data, int level)
+{
+  std::string out;
+  if (!deflate_append(out, data, level, duckdb_miniz::MZ_DEFAULT_WINDOW_BITS))
+  {
+    return std::string();
+  }
+  return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// zstd_compress
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string zstd_compress(const std::string& data, int level)
+{
+  std::string out;
+  out.resize(duckdb_zstd::ZSTD_compressBound(data.size()));
+  size_t written = duckdb_zstd::ZSTD_compress(&out[0], out.size(), data.data(), data.size(), level);
+  if (duckdb_zstd::ZSTD_isError(written))
+  {
+    return std::string();
+  }
+  out.resize(written);
+  return out;
+}
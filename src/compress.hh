@@ -0,0 +1,17 @@
+#ifndef ELECTIONS_COMPRESS_HH
+#define ELECTIONS_COMPRESS_HH
+
+#include <string>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// compression
+// gzip (deflate from miniz) and zstd, both from the libraries bundled with DuckDB;
+// an empty result means the compressor failed
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string gzip_compress(const std::string& data, int level = 9);
+std::string zlib_compress(const std::string& data, int level = 6);
+std::string zstd_compress(const std::string& data, int level = 19);
+unsigned long crc32_update(unsigned long crc, const void* data, size_t size);
+
+#endif
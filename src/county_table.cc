@@ -0,0 +1,291 @@
+#include "county_table.hh"
+#include "data.hh"
+#include "snapshot.hh"
+#include <cstdlib>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// string_dictionary_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t string_dictionary_t::intern(const std::string& str)
+{
+  std::unordered_map<std::string, uint32_t>::const_iterator it = ids.find(str);
+  if (it != ids.end())
+  {
+    return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(strings.size());
+  strings.push_back(str);
+  ids.emplace(str, id);
+  return id;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write, read
+// snapshot encoding: the strings in id order, so reading back assigns the same ids
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void string_dictionary_t::write(std::string& out) const
+{
+  put_value<uint64_t>(out, strings.size());
+  for (size_t idx = 0; idx < strings.size(); idx++)
+  {
+    put_string(out, strings[idx]);
+  }
+}
+
+bool string_dictionary_t::read(std::string_view& in)
+{
+  uint64_t count = 0;
+  if (!get_value(in, count))
+  {
+    return false;
+  }
+  for (uint64_t idx = 0; idx < count; idx++)
+  {
+    std::string_view str;
+    if (!get_string(in, str))
+    {
+      return false;
+    }
+    intern(std::string(str));
+  }
+  return strings.size() == count;
+}
+
+size_t string_dictionary_t::bytes() const
+{
+  size_t size = strings.capacity() * sizeof(std::string);
+  for (size_t idx = 0; idx < strings.size(); idx++)
+  {
+    // the string and its key in the index
+    size += 2 * (strings[idx].capacity() + 1) + sizeof(std::string) + sizeof(uint32_t) + 2 * sizeof(void*);
+  }
+  return size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// county_table_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void county_table_t::reserve(size_t count)
+{
+  id.reserve(count);
+  votes_gop.reserve(count);
+  votes_dem.reserve(count);
+  votes_total.reserve(count);
+  per_gop.reserve(count);
+  per_dem.reserve(count);
+  margin.reserve(count);
+  name_id.reserve(count);
+  state_name_id.reserve(count);
+  state_fips_id.reserve(count);
+  fips_text.reserve(count * 5);
+  fips_offset.reserve(count + 1);
+  geometry_offset.reserve(count + 1);
+}
+
+void county_table_t::append(const county_record& rec)
+{
+  if (fips_offset.empty())
+  {
+    fips_offset.push_back(0);
+    geometry_offset.push_back(0);
+  }
+
+  id.push_back(static_cast<uint32_t>(std::strtoul(rec.fips.c_str(), nullptr, 10)));
+  votes_gop.push_back(rec.votes_gop);
+  votes_dem.push_back(rec.votes_dem);
+  votes_total.push_back(rec.votes_total);
+  per_gop.push_back(rec.per_gop);
+  per_dem.push_back(rec.per_dem);
+  margin.push_back(rec.margin);
+  name_id.push_back(names.intern(rec.name));
+  state_name_id.push_back(state_names.intern(rec.state_name));
+  state_fips_id.push_back(state_codes.intern(rec.state_fips));
+
+  fips_text += rec.fips;
+  fips_offset.push_back(static_cast<uint32_t>(fips_text.size()));
+
+  // "null" is what ST_AsGeoJSON gives for a missing geometry
+  if (rec.geojson != "null")
+  {
+    geometry += rec.geojson;
+  }
+  geometry_offset.push_back(geometry.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// set_votes
+// shares and margin follow the counts, as update_results computes them
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void county_table_t::set_votes(size_t idx, int64_t gop, int64_t dem, int64_t total)
+{
+  votes_gop[idx] = gop;
+  votes_dem[idx] = dem;
+  votes_total[idx] = total;
+  per_gop[idx] = (total > 0) ? static_cast<double>(gop) / total : 0.0;
+  per_dem[idx] = (total > 0) ? static_cast<double>(dem) / total : 0.0;
+  margin[idx] = per_gop[idx] - per_dem[idx];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// release_geometry
+// year payloads keep only the numbers and names, geometry is served once per level
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void county_table_t::release_geometry()
+{
+  std::string().swap(geometry);
+  std::vector<size_t>().swap(geometry_offset);
+}
+
+std::string_view county_table_t::fips(size_t idx) const
+{
+  return std::string_view(fips_text).substr(fips_offset[idx], fips_offset[idx + 1] - fips_offset[idx]);
+}
+
+std::string_view county_table_t::geojson(size_t idx) const
+{
+  if (geometry_offset.empty())
+  {
+    return std::string_view();
+  }
+  return std::string_view(geometry).substr(geometry_offset[idx], geometry_offset[idx + 1] - geometry_offset[idx]);
+}
+
+county_record county_table_t::record(size_t idx) const
+{
+  county_record rec;
+  rec.fips = std::string(fips(idx));
+  rec.name = name(idx);
+  rec.state_name = state_name(idx);
+  rec.state_fips = state_fips(idx);
+  rec.votes_gop = votes_gop[idx];
+  rec.votes_dem = votes_dem[idx];
+  rec.votes_total = votes_total[idx];
+  rec.per_gop = per_gop[idx];
+  rec.per_dem = per_dem[idx];
+  rec.margin = margin[idx];
+  rec.geojson = std::string(geojson(idx));
+  return rec;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bytes
+// approximate heap size
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t county_table_t::bytes() const
+{
+  return sizeof(county_table_t) +
+    id.capacity() * sizeof(uint32_t) +
+    (votes_gop.capacity() + votes_dem.capacity() + votes_total.capacity()) * sizeof(int64_t) +
+    (per_gop.capacity() + per_dem.capacity() + margin.capacity()) * sizeof(double) +
+    (name_id.capacity() + state_name_id.capacity() + state_fips_id.capacity()) * sizeof(uint32_t) +
+    names.bytes() + state_names.bytes() + state_codes.bytes() +
+    fips_text.capacity() + fips_offset.capacity() * sizeof(uint32_t) +
+    geometry.capacity() + geometry_offset.capacity() * sizeof(size_t);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write, read
+// snapshot encoding: each column as one array, copied back without per-row work
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void county_table_t::write(std::string& out) const
+{
+  put_array(out, id);
+  put_array(out, votes_gop);
+  put_array(out, votes_dem);
+  put_array(out, votes_total);
+  put_array(out, per_gop);
+  put_array(out, per_dem);
+  put_array(out, margin);
+  put_array(out, name_id);
+  put_array(out, state_name_id);
+  put_array(out, state_fips_id);
+  names.write(out);
+  state_names.write(out);
+  state_codes.write(out);
+  put_string(out, fips_text);
+  put_array(out, fips_offset);
+  put_string(out, geometry);
+  put_array(out, geometry_offset);
+}
+
+bool county_table_t::read(std::string_view& in)
+{
+  std::string_view text;
+  std::string_view geojson;
+  if (!get_array(in, id) || !get_array(in, votes_gop) || !get_array(in, votes_dem) || !get_array(in, votes_total) ||
+    !get_array(in, per_gop) || !get_array(in, per_dem) || !get_array(in, margin) ||
+    !get_array(in, name_id) || !get_array(in, state_name_id) || !get_array(in, state_fips_id) ||
+    !names.read(in) || !state_names.read(in) || !state_codes.read(in) ||
+    !get_string(in, text) || !get_array(in, fips_offset) || !get_string(in, geojson) || !get_array(in, geometry_offset))
+  {
+    return false;
+  }
+  fips_text = text;
+  geometry = geojson;
+  return valid();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// valid
+// every column has a row per county, interned ids are within their dictionaries and the offsets
+// rise within their buffers; a damaged section is rejected instead of read out of bounds
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool county_table_t::valid() const
+{
+  size_t count = id.size();
+  if (votes_gop.size() != count || votes_dem.size() != count || votes_total.size() != count ||
+    per_gop.size() != count || per_dem.size() != count || margin.size() != count ||
+    name_id.size() != count || state_name_id.size() != count || state_fips_id.size() != count)
+  {
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++)
+  {
+    if (name_id[idx] >= names.size() || state_name_id[idx] >= state_names.size() || state_fips_id[idx] >= state_codes.size())
+    {
+      return false;
+    }
+  }
+
+  if (fips_offset.empty())
+  {
+    return count == 0 && geometry_offset.empty();
+  }
+  if (fips_offset.size() != count + 1 || fips_offset[0] != 0 || fips_offset[count] > fips_text.size())
+  {
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++)
+  {
+    if (fips_offset[idx] > fips_offset[idx + 1])
+    {
+      return false;
+    }
+  }
+
+  // geometry is released in year payloads
+  if (geometry_offset.empty())
+  {
+    return true;
+  }
+  if (geometry_offset.size() != count + 1 || geometry_offset[0] != 0 || geometry_offset[count] > geometry.size())
+  {
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++)
+  {
+    if (geometry_offset[idx] > geometry_offset[idx + 1])
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,80 @@
+#ifndef ELECTIONS_COUNTY_TABLE_HH
+#define ELECTIONS_COUNTY_TABLE_HH
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+struct county_record;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// string_dictionary_t
+// interned strings: each distinct string is stored once and referenced by a 32 bit id
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class string_dictionary_t
+{
+public:
+  uint32_t intern(const std::string& str);
+  const std::string& get(uint32_t id) const { return strings[id]; }
+  size_t size() const { return strings.size(); }
+  size_t bytes() const;
+  void write(std::string& out) const;
+  bool read(std::string_view& in);
+
+private:
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> ids;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// county_table_t
+// counties of a year as columns: contiguous arrays for the numbers and the numeric FIPS id, so
+// the per-county loops (attributes, raster colors, export) walk memory in order; county and state
+// names interned, FIPS codes and GeoJSON geometry by offset into one shared buffer each
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class county_table_t
+{
+public:
+  std::vector<uint32_t> id;  // numeric FIPS, the feature id
+  std::vector<int64_t> votes_gop;
+  std::vector<int64_t> votes_dem;
+  std::vector<int64_t> votes_total;
+  std::vector<double> per_gop;
+  std::vector<double> per_dem;
+  std::vector<double> margin;
+
+  size_t size() const { return id.size(); }
+  void reserve(size_t count);
+  void append(const county_record& rec);
+  void set_votes(size_t idx, int64_t gop, int64_t dem, int64_t total);
+  void release_geometry();
+
+  std::string_view fips(size_t idx) const;
+  const std::string& name(size_t idx) const { return names.get(name_id[idx]); }
+  const std::string& state_name(size_t idx) const { return state_names.get(state_name_id[idx]); }
+  const std::string& state_fips(size_t idx) const { return state_codes.get(state_fips_id[idx]); }
+  std::string_view geojson(size_t idx) const;
+  county_record record(size_t idx) const;
+  size_t bytes() const;
+  void write(std::string& out) const;
+  bool read(std::string_view& in);
+  bool valid() const;
+
+private:
+  std::vector<uint32_t> name_id;
+  std::vector<uint32_t> state_name_id;
+  std::vector<uint32_t> state_fips_id;
+  string_dictionary_t names;
+  string_dictionary_t state_names;
+  string_dictionary_t state_codes;
+  std::string fips_text;
+  std::vector<uint32_t> fips_offset;  // size() + 1 entries
+  std::string geometry;
+  std::vector<size_t> geometry_offset;  // size() + 1 entries, empty once released
+};
+
+#endif
@@ -1,22 +1,342 @@
 #include "data.hh"
+#include "topology.hh"
+#include "json.hh"
+#include "column.hh"
 #include <fstream>
+#include <filesystem>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cerrno>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// prepared statement SQL
+// $1 is the year, $2 the geometry level; each statement is parsed and planned once per connection.
+// GeoJSON is serialized once by build_geojson, the year queries only join the results
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const char* sql_counties = R"(
+    SELECT 
+      c.fips,
+      COALESCE(r.county_name, c.name) as name,
+      COALESCE(s.name, '') as state_name,
+      c.state_fips,
+      COALESCE(r.votes_gop, 0) as votes_gop,
+      COALESCE(r.votes_dem, 0) as votes_dem,
+      COALESCE(r.votes_total, 0) as votes_total,
+      COALESCE(r.per_gop, 0) as per_gop,
+      COALESCE(r.per_dem, 0) as per_dem,
+      COALESCE(r.margin, 0) as margin,
+      CAST(NULL AS VARCHAR) as geojson
+    FROM counties c
+    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = $1
+    LEFT JOIN state_names s ON c.state_fips = s.fips
+    ORDER BY c.fips
+  )";
+
+// same rows with the stored GeoJSON of a level; counties missing from the level use level 0
+static const char* sql_county_geometry = R"(
+    SELECT 
+      c.fips,
+      COALESCE(r.county_name, c.name) as name,
+      COALESCE(s.name, '') as state_name,
+      c.state_fips,
+      COALESCE(r.votes_gop, 0) as votes_gop,
+      COALESCE(r.votes_dem, 0) as votes_dem,
+      COALESCE(r.votes_total, 0) as votes_total,
+      COALESCE(r.per_gop, 0) as per_gop,
+      COALESCE(r.per_dem, 0) as per_dem,
+      COALESCE(r.margin, 0) as margin,
+      COALESCE(g.geojson, g0.geojson) as geojson
+    FROM counties c
+    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = $1
+    LEFT JOIN state_names s ON c.state_fips = s.fips
+    LEFT JOIN county_geojson g ON c.fips = g.fips AND g.level = $2
+    LEFT JOIN county_geojson g0 ON c.fips = g0.fips AND g0.level = 0
+    ORDER BY c.fips
+  )";
+
+static const char* sql_states = R"(
+    SELECT 
+      a.state_fips as fips,
+      s.name as state_name,
+      a.votes_gop,
+      a.votes_dem,
+      a.votes_total
+    FROM state_results a
+    LEFT JOIN state_names s ON a.state_fips = s.fips
+    WHERE a.year = $1
+    ORDER BY s.name
+  )";
+
+// decoded by get_shapes; here $1 is the level, names come from the most recent year with results
+static const char* sql_shapes = R"(
+    SELECT 
+      c.fips,
+      COALESCE(r.county_name, c.name) as name,
+      COALESCE(s.name, '') as state_name,
+      ST_AsWKB(COALESCE(l.geometry, c.geometry)) as wkb
+    FROM counties c
+    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = (SELECT MAX(year) FROM results)
+    LEFT JOIN state_names s ON c.state_fips = s.fips
+    LEFT JOIN county_levels l ON c.fips = l.fips AND l.level = $1
+    WHERE c.geometry IS NOT NULL
+    ORDER BY c.fips
+  )";
+
+static const char* sql_national = "SELECT votes_gop, votes_dem, votes_total FROM national_results WHERE year = $1";
+static const char* sql_delete_year = "DELETE FROM results WHERE year = $1";
+static const char* sql_count_year = "SELECT COUNT(*) FROM results WHERE year = $1";
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// prepare
+// cached statement, prepared on first use; null (error printed) when preparation fails
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static duckdb::PreparedStatement* prepare(duckdb::Connection& conn, std::unique_ptr<duckdb::PreparedStatement>& statement, const char* sql)
+{
+  if (!statement)
+  {
+    statement = conn.Prepare(sql);
+  }
+  if (statement->HasError())
+  {
+    std::cerr << statement->GetError() << std::endl;
+    statement.reset();
+    return nullptr;
+  }
+  return statement.get();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// sql_string
+// a file path as a quoted SQL literal, for the table functions that take no parameters
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string sql_string(const std::string& str)
+{
+  std::string literal = "'";
+  for (size_t idx = 0; idx < str.size(); idx++)
+  {
+    literal += str[idx];
+    if (str[idx] == '\'') literal += '\'';
+  }
+  return literal + "'";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// record extraction
+// the columnar path reads the flat vectors of a chunk directly; the Value path boxes every cell
+// and converts, and is kept for results whose column types differ (and as the benchmark baseline)
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const std::vector<duckdb::PhysicalType> county_types =
+{
+  duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR,
+  duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64,
+  duckdb::PhysicalType::DOUBLE, duckdb::PhysicalType::DOUBLE, duckdb::PhysicalType::DOUBLE,
+  duckdb::PhysicalType::VARCHAR
+};
+
+static const std::vector<duckdb::PhysicalType> state_types =
+{
+  duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR,
+  duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64
+};
+
+static void append_counties_values(duckdb::DataChunk& chunk, std::vector<county_record>& records)
+{
+  for (size_t idx = 0; idx < chunk.size(); idx++)
+  {
+    county_record rec;
+    rec.fips = chunk.GetValue(0, idx).ToString();
+
+    duckdb::Value name_val = chunk.GetValue(1, idx);
+    if (name_val.IsNull())
+    {
+      rec.name = "";
+    }
+    else
+    {
+      rec.name = name_val.ToString();
+    }
+
+    duckdb::Value state_val = chunk.GetValue(2, idx);
+    if (state_val.IsNull())
+    {
+      rec.state_name = "";
+    }
+    else
+    {
+      rec.state_name = state_val.ToString();
+    }
+
+    rec.state_fips = chunk.GetValue(3, idx).ToString();
+    rec.votes_gop = chunk.GetValue(4, idx).GetValue<int64_t>();
+    rec.votes_dem = chunk.GetValue(5, idx).GetValue<int64_t>();
+    rec.votes_total = chunk.GetValue(6, idx).GetValue<int64_t>();
+    rec.per_gop = chunk.GetValue(7, idx).GetValue<double>();
+    rec.per_dem = chunk.GetValue(8, idx).GetValue<double>();
+    rec.margin = chunk.GetValue(9, idx).GetValue<double>();
+    duckdb::Value geojson_val = chunk.GetValue(10, idx);
+    if (!geojson_val.IsNull())
+    {
+      rec.geojson = geojson_val.ToString();
+    }
+    records.push_back(rec);
+  }
+}
+
+static void append_counties_columnar(duckdb::DataChunk& chunk, std::vector<county_record>& records)
+{
+  chunk.Flatten();
+  string_column_t fips(chunk.data[0]);
+  string_column_t name(chunk.data[1]);
+  string_column_t state_name(chunk.data[2]);
+  string_column_t state_fips(chunk.data[3]);
+  column_t<int64_t> votes_gop(chunk.data[4]);
+  column_t<int64_t> votes_dem(chunk.data[5]);
+  column_t<int64_t> votes_total(chunk.data[6]);
+  column_t<double> per_gop(chunk.data[7]);
+  column_t<double> per_dem(chunk.data[8]);
+  column_t<double> margin(chunk.data[9]);
+  string_column_t geojson(chunk.data[10]);
+
+  size_t offset = records.size();
+  records.resize(offset + chunk.size());
+  for (size_t idx = 0; idx < chunk.size(); idx++)
+  {
+    county_record& rec = records[offset + idx];
+    fips.get(idx, rec.fips);
+    name.get(idx, rec.name);
+    state_name.get(idx, rec.state_name);
+    state_fips.get(idx, rec.state_fips);
+    rec.votes_gop = votes_gop.get(idx);
+    rec.votes_dem = votes_dem.get(idx);
+    rec.votes_total = votes_total.get(idx);
+    rec.per_gop = per_gop.get(idx);
+    rec.per_dem = per_dem.get(idx);
+    rec.margin = margin.get(idx);
+    geojson.get(idx, rec.geojson);
+  }
+}
+
+static void append_states_values(duckdb::DataChunk& chunk, std::vector<state_record>& records)
+{
+  for (size_t idx = 0; idx < chunk.size(); idx++)
+  {
+    state_record rec;
+    rec.fips = chunk.GetValue(0, idx).ToString();
+    rec.name = chunk.GetValue(1, idx).ToString();
+    rec.votes_gop = chunk.GetValue(2, idx).GetValue<int64_t>();
+    rec.votes_dem = chunk.GetValue(3, idx).GetValue<int64_t>();
+    rec.votes_total = chunk.GetValue(4, idx).GetValue<int64_t>();
+    rec.per_gop = (rec.votes_total > 0) ? static_cast<double>(rec.votes_gop) / rec.votes_total : 0.0;
+    rec.per_dem = (rec.votes_total > 0) ? static_cast<double>(rec.votes_dem) / rec.votes_total : 0.0;
+    rec.winner = (rec.votes_gop > rec.votes_dem) ? "GOP" : "DEM";
+    records.push_back(rec);
+  }
+}
+
+static void append_states_columnar(duckdb::DataChunk& chunk, std::vector<state_record>& records)
+{
+  chunk.Flatten();
+  string_column_t fips(chunk.data[0]);
+  string_column_t name(chunk.data[1]);
+  column_t<int64_t> votes_gop(chunk.data[2]);
+  column_t<int64_t> votes_dem(chunk.data[3]);
+  column_t<int64_t> votes_total(chunk.data[4]);
+
+  size_t offset = records.size();
+  records.resize(offset + chunk.size());
+  for (size_t idx = 0; idx < chunk.size(); idx++)
+  {
+    state_record& rec = records[offset + idx];
+    fips.get(idx, rec.fips);
+    name.get(idx, rec.name);
+    rec.votes_gop = votes_gop.get(idx);
+    rec.votes_dem = votes_dem.get(idx);
+    rec.votes_total = votes_total.get(idx);
+    rec.per_gop = (rec.votes_total > 0) ? static_cast<double>(rec.votes_gop) / rec.votes_total : 0.0;
+    rec.per_dem = (rec.votes_total > 0) ? static_cast<double>(rec.votes_dem) / rec.votes_total : 0.0;
+    rec.winner = (rec.votes_gop > rec.votes_dem) ? "GOP" : "DEM";
+  }
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // database_t
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-database_t::database_t(const std::string& path) : db_path(path)
+database_t::database_t(const std::string& path, size_t max_connections_, bool read_only_)
+  : db_path(path), read_only(read_only_), max_connections(max_connections_), open_connections(0)
 {
+  if (max_connections == 0)
+  {
+    max_connections = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
   duckdb::DBConfig config;
+#ifdef ELECTIONS_SPATIAL_STATIC
+  // every extension used is linked in; never reach for the extension repository
+  config.options.autoinstall_known_extensions = false;
+#endif
+  // a read-only open takes a shared lock, so any number of processes can serve one file
+  if (read_only)
+  {
+    config.options.access_mode = duckdb::AccessMode::READ_ONLY;
+  }
   db = std::make_unique<duckdb::DuckDB>(db_path, &config);
   conn = std::make_unique<duckdb::Connection>(*db);
 
-  conn->Query("INSTALL spatial;");
-  conn->Query("LOAD spatial;");
+  std::chrono::steady_clock::time_point opened = std::chrono::steady_clock::now();
+  timing.open = std::chrono::duration<double, std::milli>(opened - start).count();
+
+  if (!load_spatial(*db, *conn))
+  {
+    throw std::runtime_error("Spatial extension not loaded, cannot open " + db_path);
+  }
+
+  std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+  timing.extension = std::chrono::duration<double, std::milli>(loaded - opened).count();
+
+  if (read_only)
+  {
+    check_schema();
+  }
+  else
+  {
+    create_schema();
+  }
+
+  std::chrono::steady_clock::time_point checked = std::chrono::steady_clock::now();
+  timing.schema = std::chrono::duration<double, std::milli>(checked - loaded).count();
+
+  // the first statement against the tables pays for loading their metadata
+  std::unique_ptr<duckdb::MaterializedQueryResult> first_result = conn->Query("SELECT COUNT(*) FROM results;");
+  if (first_result->HasError())
+  {
+    std::cerr << first_result->GetError() << std::endl;
+  }
+  timing.first_query = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - checked).count();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// create_schema
+// tables, state names and migrations of databases written by older loaders; read-write only
+/////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void database_t::create_schema()
+{
   conn->Query(R"(
     CREATE TABLE IF NOT EXISTS counties (
       fips VARCHAR PRIMARY KEY,
@@ -57,11 +377,13 @@ database_t::database_t(const std::string& path) : db_path(path)
     "54", "West Virginia", "55", "Wisconsin", "56", "Wyoming", nullptr, nullptr
   };
 
+  // one statement for all states rather than a query each
+  std::string state_values;
   for (int idx = 0; state_data[idx] != nullptr; idx += 2)
   {
-    conn->Query("INSERT OR IGNORE INTO state_names VALUES ('" +
-      std::string(state_data[idx]) + "', '" + std::string(state_data[idx + 1]) + "');");
+    state_values += std::string(idx == 0 ? "" : ", ") + "('" + state_data[idx] + "', '" + state_data[idx + 1] + "')";
   }
+  conn->Query("INSERT OR IGNORE INTO state_names VALUES " + state_values + ";");
 
   conn->Query(R"(
     CREATE TABLE IF NOT EXISTS results (
@@ -78,6 +400,75 @@ database_t::database_t(const std::string& path) : db_path(path)
     );
   )");
 
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS meta (
+      key VARCHAR PRIMARY KEY,
+      value VARCHAR NOT NULL
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS county_geojson (
+      fips VARCHAR NOT NULL,
+      level INTEGER NOT NULL,
+      geojson VARCHAR,
+      PRIMARY KEY (fips, level)
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS state_results (
+      year INTEGER NOT NULL,
+      state_fips VARCHAR NOT NULL,
+      votes_gop BIGINT NOT NULL,
+      votes_dem BIGINT NOT NULL,
+      votes_total BIGINT NOT NULL,
+      PRIMARY KEY (year, state_fips)
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS national_results (
+      year INTEGER PRIMARY KEY,
+      votes_gop BIGINT NOT NULL,
+      votes_dem BIGINT NOT NULL,
+      votes_total BIGINT NOT NULL
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS county_swing (
+      year INTEGER NOT NULL,
+      base_year INTEGER NOT NULL,
+      county_fips VARCHAR NOT NULL,
+      margin_shift DOUBLE NOT NULL,
+      per_gop_shift DOUBLE NOT NULL,
+      per_dem_shift DOUBLE NOT NULL,
+      turnout_change DOUBLE,
+      votes_total_change BIGINT NOT NULL,
+      PRIMARY KEY (year, base_year, county_fips)
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS tiles (
+      z INTEGER NOT NULL,
+      x INTEGER NOT NULL,
+      y INTEGER NOT NULL,
+      data BLOB NOT NULL,
+      PRIMARY KEY (z, x, y)
+    );
+  )");
+
+  conn->Query(R"(
+    CREATE TABLE IF NOT EXISTS county_levels (
+      fips VARCHAR NOT NULL,
+      level INTEGER NOT NULL,
+      geometry GEOMETRY,
+      PRIMARY KEY (fips, level)
+    );
+  )");
+
   // add county_name column if it doesn't exist (for existing databases)
   std::unique_ptr<duckdb::MaterializedQueryResult> check_result = conn->Query(
     "SELECT column_name FROM information_schema.columns WHERE table_name = 'results' AND column_name = 'county_name'");
@@ -87,89 +478,335 @@ database_t::database_t(const std::string& path) : db_path(path)
     conn->Query("ALTER TABLE results ADD COLUMN county_name VARCHAR;");
     std::cout << "Added county_name column to results table" << std::endl;
   }
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-// load_topojson
-/////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int database_t::load_topojson(const std::string& json_path)
-{
-  std::ifstream file(json_path);
-  if (!file.is_open())
+  // GeoJSON for databases loaded before county_geojson existed
+  std::unique_ptr<duckdb::MaterializedQueryResult> geojson_result = conn->Query(
+    "SELECT (SELECT COUNT(*) FROM county_geojson) = 0 AND (SELECT COUNT(*) FROM counties) > 0");
+  duckdb::unique_ptr<duckdb::DataChunk> geojson_chunk = geojson_result->HasError() ? nullptr : geojson_result->Fetch();
+  if (geojson_chunk && geojson_chunk->size() > 0 && geojson_chunk->GetValue(0, 0).GetValue<bool>())
   {
-    return -1;
+    build_geojson();
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  std::string json_str = buffer.str();
-  file.close();
-
-  bool is_topojson = json_str.find("\"type\":\"Topology\"") != std::string::npos ||
-    json_str.find("\"type\": \"Topology\"") != std::string::npos;
-
-  if (is_topojson)
+  // aggregates for years loaded before state_results and national_results existed
+  std::unique_ptr<duckdb::MaterializedQueryResult> missing_result = conn->Query(
+    "SELECT DISTINCT year FROM results WHERE year NOT IN (SELECT year FROM national_results) ORDER BY year");
+  std::vector<int> missing;
+  duckdb::unique_ptr<duckdb::DataChunk> missing_chunk;
+  while (!missing_result->HasError() && (missing_chunk = missing_result->Fetch()) != nullptr)
   {
-    conn->Query("DELETE FROM counties;");
-    conn->Query("DELETE FROM states;");
-
-    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(
-      "SELECT * FROM ST_Read('" + json_path + "', layer='counties') LIMIT 1;"
-    );
-
-    if (result->HasError())
+    for (size_t idx = 0; idx < missing_chunk->size(); idx++)
     {
-      std::cerr << result->GetError() << std::endl;
-      return -1;
+      missing.push_back(missing_chunk->GetValue(0, idx).GetValue<int>());
     }
+  }
+  for (size_t idx = 0; idx < missing.size(); idx++)
+  {
+    build_aggregates(missing[idx]);
+  }
 
-    std::unique_ptr<duckdb::MaterializedQueryResult> counties_result = conn->Query(R"(
-      INSERT INTO counties (fips, name, state_fips, geometry)
-      SELECT 
-        LPAD(CAST(id AS VARCHAR), 5, '0') as fips,
-        '' as name,
-        SUBSTR(LPAD(CAST(id AS VARCHAR), 5, '0'), 1, 2) as state_fips,
-        geom as geometry
-      FROM ST_Read(')" + json_path + R"(', layer='counties')
-      ON CONFLICT (fips) DO UPDATE SET geometry = EXCLUDED.geometry;
-    )");
-
-    if (counties_result->HasError())
+  // swing for years loaded before county_swing existed, once there are two years to compare
+  std::unique_ptr<duckdb::MaterializedQueryResult> swing_result = conn->Query(R"(
+    SELECT DISTINCT year FROM results
+    WHERE year NOT IN (SELECT year FROM county_swing UNION SELECT base_year FROM county_swing)
+      AND (SELECT COUNT(DISTINCT year) FROM results) > 1
+    ORDER BY year
+  )");
+  missing.clear();
+  while (!swing_result->HasError() && (missing_chunk = swing_result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < missing_chunk->size(); idx++)
     {
-      std::cerr << counties_result->GetError() << std::endl;
+      missing.push_back(missing_chunk->GetValue(0, idx).GetValue<int>());
     }
+  }
+  build_swing(missing);
+}
 
-    std::unique_ptr<duckdb::MaterializedQueryResult> states_result = conn->Query(R"(
-      INSERT INTO states (fips, name, geometry)
-      SELECT 
-        LPAD(CAST(id AS VARCHAR), 2, '0') as fips,
-        '' as name,
-        geom as geometry
-      FROM ST_Read(')" + json_path + R"(', layer='states')
-      ON CONFLICT (fips) DO UPDATE SET geometry = EXCLUDED.geometry;
-    )");
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// check_schema
+// read-only: nothing is created or migrated, so every table must already be there, as written
+// by the current loader
+/////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    if (states_result->HasError())
+void database_t::check_schema()
+{
+  static const char* tables[] =
+  {
+    "counties", "states", "state_names", "results", "meta", "county_geojson", "state_results",
+    "national_results", "county_swing", "tiles", "county_levels", nullptr
+  };
+
+  std::string missing;
+  for (int idx = 0; tables[idx] != nullptr; idx++)
+  {
+    std::unique_ptr<duckdb::QueryResult> result = conn->Query(
+      "SELECT COUNT(*) FROM information_schema.tables WHERE table_name = $1", duckdb::Value(tables[idx]));
+    duckdb::unique_ptr<duckdb::DataChunk> chunk = result->HasError() ? nullptr : result->Fetch();
+    if (!chunk || chunk->size() == 0 || chunk->GetValue(0, 0).GetValue<int64_t>() == 0)
     {
-      std::cerr << states_result->GetError() << std::endl;
+      missing += std::string(missing.empty() ? "" : ", ") + tables[idx];
     }
   }
+  if (!missing.empty())
+  {
+    throw std::runtime_error(db_path + " opened read-only is missing " + missing + "; run the loader on it first");
+  }
+}
 
-  /////////////////////////////////////////////////////////////////////////////////////////////////////
-  // geojson
-  /////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// writable
+// false (error printed) when the database was opened read-only
+/////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  else
+bool database_t::writable(const char* operation)
+{
+  if (read_only)
   {
+    std::cerr << "Cannot " << operation << ": " << db_path << " is opened read-only" << std::endl;
+    return false;
+  }
+  return true;
+}
 
-    conn->Query("DELETE FROM counties;");
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// print_startup_timing
+/////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
-      INSERT INTO counties (fips, name, state_fips, geometry)
-      SELECT 
-        LPAD(CAST(id AS VARCHAR), 5, '0') as fips,
-        '' as name,
+void database_t::print_startup_timing()
+{
+  std::cout << std::fixed << std::setprecision(1) << "Database startup: open " << timing.open
+    << " ms, spatial " << timing.extension << " ms, schema " << timing.schema
+    << " ms, first query " << timing.first_query << " ms, total "
+    << (timing.open + timing.extension + timing.schema + timing.first_query) << " ms" << std::defaultfloat << std::endl;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// checkout
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::unique_ptr<connection_t> database_t::checkout()
+{
+  {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    pool_returned.wait(lock, [this] { return !idle.empty() || open_connections < max_connections; });
+    if (!idle.empty())
+    {
+      std::unique_ptr<connection_t> connection = std::move(idle.back());
+      idle.pop_back();
+      return connection;
+    }
+    open_connections++;
+  }
+
+  // opened outside the lock, other readers keep checking out; a failed open gives its slot back
+  std::unique_ptr<connection_t> connection;
+  try
+  {
+    connection = std::make_unique<connection_t>();
+    connection->conn = std::make_unique<duckdb::Connection>(*db);
+  }
+  catch (...)
+  {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      open_connections--;
+    }
+    pool_returned.notify_one();
+    throw;
+  }
+  return connection;
+}
+
+void database_t::checkin(std::unique_ptr<connection_t> connection)
+{
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    idle.push_back(std::move(connection));
+  }
+  pool_returned.notify_one();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_meta, set_meta
+// key/value rows of the meta table, on the primary connection
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string database_t::get_meta(const std::string& key)
+{
+  std::unique_ptr<duckdb::QueryResult> result = conn->Query("SELECT value FROM meta WHERE key = $1", duckdb::Value(key));
+  if (result->HasError())
+  {
+    return "";
+  }
+  duckdb::unique_ptr<duckdb::DataChunk> chunk = result->Fetch();
+  if (!chunk || chunk->size() == 0)
+  {
+    return "";
+  }
+  return chunk->GetValue(0, 0).ToString();
+}
+
+void database_t::set_meta(const std::string& key, const std::string& value)
+{
+  conn->Query("INSERT OR REPLACE INTO meta VALUES ($1, $2)", duckdb::Value(key), duckdb::Value(value));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// file_hash
+// 64-bit FNV-1a of a file's contents as 16 hex digits; empty when the file cannot be read
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string file_hash(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+  {
+    return "";
+  }
+  uint64_t hash = 14695981039346656037ULL;
+  std::vector<char> buffer(1 << 20);
+  while (file)
+  {
+    file.read(buffer.data(), buffer.size());
+    std::streamsize count = file.gcount();
+    for (std::streamsize idx = 0; idx < count; ++idx)
+    {
+      hash ^= static_cast<unsigned char>(buffer[idx]);
+      hash *= 1099511628211ULL;
+    }
+  }
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// is_loaded
+// true when the counties were loaded from a file with the same contents, so the loader can skip
+// the geometry reload and the simplification levels
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool database_t::is_loaded(const std::string& json_path)
+{
+  std::string hash = file_hash(json_path);
+  if (hash.empty() || hash != get_meta("topojson_hash"))
+  {
+    return false;
+  }
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query("SELECT COUNT(*) FROM counties;");
+  duckdb::unique_ptr<duckdb::DataChunk> chunk = result->HasError() ? nullptr : result->Fetch();
+  return chunk && chunk->size() > 0 && chunk->GetValue(0, 0).GetValue<int64_t>() > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// set_loaded
+// records the file's contents hash for is_loaded; called once the counties and their levels are
+// complete, so a load that fails partway is redone by the next run
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void database_t::set_loaded(const std::string& json_path)
+{
+  if (writable("record the counties file"))
+  {
+    set_meta("topojson_hash", file_hash(json_path));
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// load_topojson
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::load_topojson(const std::string& json_path)
+{
+  if (!writable("load counties"))
+  {
+    return -1;
+  }
+
+  std::ifstream file(json_path);
+  if (!file.is_open())
+  {
+    return -1;
+  }
+
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  std::string json_str = buffer.str();
+  file.close();
+
+  // recorded by set_loaded once the levels are built
+  set_meta("topojson_hash", "");
+
+  bool is_topojson = json_str.find("\"type\":\"Topology\"") != std::string::npos ||
+    json_str.find("\"type\": \"Topology\"") != std::string::npos;
+
+  if (is_topojson)
+  {
+    conn->Query("DELETE FROM counties;");
+    conn->Query("DELETE FROM states;");
+    conn->Query("DELETE FROM tiles;");
+    conn->Query("DELETE FROM county_levels;");
+
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(
+      "SELECT * FROM ST_Read('" + json_path + "', layer='counties') LIMIT 1;"
+    );
+
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      return -1;
+    }
+
+    std::unique_ptr<duckdb::MaterializedQueryResult> counties_result = conn->Query(R"(
+      INSERT INTO counties (fips, name, state_fips, geometry)
+      SELECT 
+        LPAD(CAST(id AS VARCHAR), 5, '0') as fips,
+        '' as name,
+        SUBSTR(LPAD(CAST(id AS VARCHAR), 5, '0'), 1, 2) as state_fips,
+        geom as geometry
+      FROM ST_Read(')" + json_path + R"(', layer='counties')
+      ON CONFLICT (fips) DO UPDATE SET geometry = EXCLUDED.geometry;
+    )");
+
+    if (counties_result->HasError())
+    {
+      std::cerr << counties_result->GetError() << std::endl;
+    }
+
+    std::unique_ptr<duckdb::MaterializedQueryResult> states_result = conn->Query(R"(
+      INSERT INTO states (fips, name, geometry)
+      SELECT 
+        LPAD(CAST(id AS VARCHAR), 2, '0') as fips,
+        '' as name,
+        geom as geometry
+      FROM ST_Read(')" + json_path + R"(', layer='states')
+      ON CONFLICT (fips) DO UPDATE SET geometry = EXCLUDED.geometry;
+    )");
+
+    if (states_result->HasError())
+    {
+      std::cerr << states_result->GetError() << std::endl;
+    }
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // geojson
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  else
+  {
+
+    conn->Query("DELETE FROM counties;");
+    conn->Query("DELETE FROM states;");
+    conn->Query("DELETE FROM tiles;");
+    conn->Query("DELETE FROM county_levels;");
+
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+      INSERT INTO counties (fips, name, state_fips, geometry)
+      SELECT 
+        LPAD(CAST(id AS VARCHAR), 5, '0') as fips,
+        '' as name,
         SUBSTR(LPAD(CAST(id AS VARCHAR), 5, '0'), 1, 2) as state_fips,
         geom as geometry
       FROM ST_Read(')" + json_path + R"(')
@@ -183,6 +820,18 @@ int database_t::load_topojson(const std::string& json_path)
     }
   }
 
+  build_states();
+
+  // the text of the old geometry; build_levels serializes the new one once its levels exist
+  conn->Query("DELETE FROM county_geojson;");
+
+  // the counties of each state come from the new geometry
+  std::vector<int> years = get_years();
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    build_aggregates(years[idx]);
+  }
+
   std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query("SELECT COUNT(*) FROM counties;");
   if (!count_result->HasError())
   {
@@ -204,12 +853,23 @@ int database_t::load_topojson(const std::string& json_path)
 
 int database_t::load_election_csv(const std::string& csv_path, int year)
 {
-  conn->Query("DELETE FROM results WHERE year = " + std::to_string(year));
+  if (!writable("load results"))
+  {
+    return -1;
+  }
+
+  duckdb::PreparedStatement* delete_year = prepare(*conn, stmt_delete_year, sql_delete_year);
+  if (!delete_year)
+  {
+    return -1;
+  }
+  delete_year->Execute(duckdb::Value::INTEGER(year));
 
+  // the path is a literal, the year is bound
   std::string sql = R"(
     INSERT INTO results (year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin)
     SELECT 
-      )" + std::to_string(year) + R"( as year,
+      CAST($1 AS INTEGER) as year,
       LPAD(CAST(county_fips AS VARCHAR), 5, '0') as county_fips,
       "county_name",
       CAST(votes_gop AS BIGINT),
@@ -218,44 +878,1240 @@ int database_t::load_election_csv(const std::string& csv_path, int year)
       per_gop,
       per_dem,
       per_gop - per_dem as margin
-    FROM read_csv(')" + csv_path + R"(', header=true)
+    FROM read_csv()" + sql_string(csv_path) + R"(, header=true)
     WHERE LENGTH(CAST(county_fips AS VARCHAR)) >= 4
   )";
 
-  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(sql);
+  std::unique_ptr<duckdb::QueryResult> result = conn->Query(sql, duckdb::Value::INTEGER(year));
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return -1;
+  }
+
+  duckdb::PreparedStatement* count_year = prepare(*conn, stmt_count_year, sql_count_year);
+  if (!count_year)
+  {
+    return -1;
+  }
+  std::unique_ptr<duckdb::QueryResult> count_result = count_year->Execute(duckdb::Value::INTEGER(year));
+  if (!count_result->HasError())
+  {
+    duckdb::unique_ptr<duckdb::DataChunk> chunk = count_result->Fetch();
+    if (chunk && chunk->size() > 0)
+    {
+      int64_t count = chunk->GetValue(0, 0).GetValue<int64_t>();
+      std::cout << "Loaded " << count << " results for " << year << std::endl;
+      if (build_aggregates(year) < 0 || build_swing(year) < 0)
+      {
+        return -1;
+      }
+      return static_cast<int>(count);
+    }
+  }
+
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_election_csv
+// the 2024 format by header name: county_fips, county_name, votes_gop, votes_dem, total_votes,
+// per_gop, per_dem. Quoted fields may contain commas; rows with FIPS shorter than 4 digits
+// (state totals) are skipped and FIPS are zero padded to 5, as load_election_csv does. A vote
+// or share that is empty or not a number fails the file with its line
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void split_csv_line(const std::string& line, std::vector<std::string>& fields)
+{
+  fields.clear();
+  std::string field;
+  bool quoted = false;
+  for (size_t idx = 0; idx < line.size(); idx++)
+  {
+    char c = line[idx];
+    if (quoted)
+    {
+      if (c == '"' && idx + 1 < line.size() && line[idx + 1] == '"')
+      {
+        field += '"';
+        idx++;
+      }
+      else if (c == '"')
+      {
+        quoted = false;
+      }
+      else
+      {
+        field += c;
+      }
+    }
+    else if (c == '"')
+    {
+      quoted = true;
+    }
+    else if (c == ',')
+    {
+      fields.push_back(field);
+      field.clear();
+    }
+    else
+    {
+      field += c;
+    }
+  }
+  fields.push_back(field);
+}
+
+static bool parse_number(const std::string& field, double& value)
+{
+  char* end = nullptr;
+  value = std::strtod(field.c_str(), &end);
+  return !field.empty() && *end == '\0' && std::isfinite(value);
+}
+
+// vote counts are whole numbers; "1.5" or an out of range count fails rather than truncating
+static bool parse_count(const std::string& field, int64_t& value)
+{
+  char* end = nullptr;
+  errno = 0;
+  long long parsed = std::strtoll(field.c_str(), &end, 10);
+  if (field.empty() || *end != '\0' || errno == ERANGE)
+  {
+    return false;
+  }
+  value = static_cast<int64_t>(parsed);
+  return true;
+}
+
+static bool parse_election_csv(const election_file& source, std::vector<county_record>& rows, std::string& error)
+{
+  std::ifstream file(source.path);
+  if (!file.is_open())
+  {
+    error = source.path + ": cannot open";
+    return false;
+  }
+
+  const char* names[] = { "county_fips", "county_name", "votes_gop", "votes_dem", "total_votes", "per_gop", "per_dem" };
+  const size_t name_count = sizeof(names) / sizeof(names[0]);
+  size_t columns[name_count];
+
+  std::string line;
+  std::vector<std::string> fields;
+  if (!std::getline(file, line))
+  {
+    error = source.path + ": empty";
+    return false;
+  }
+  if (!line.empty() && line.back() == '\r') line.pop_back();
+  split_csv_line(line, fields);
+  size_t max_column = 0;
+  for (size_t idx = 0; idx < name_count; idx++)
+  {
+    std::vector<std::string>::const_iterator it = std::find(fields.begin(), fields.end(), names[idx]);
+    if (it == fields.end())
+    {
+      error = source.path + ": no column " + names[idx];
+      return false;
+    }
+    columns[idx] = it - fields.begin();
+    max_column = std::max(max_column, columns[idx]);
+  }
+
+  int line_number = 1;
+  while (std::getline(file, line))
+  {
+    line_number++;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    split_csv_line(line, fields);
+    if (fields.size() <= max_column)
+    {
+      error = source.path + ": line " + std::to_string(line_number) + " has " + std::to_string(fields.size()) + " fields";
+      return false;
+    }
+
+    const std::string& fips = fields[columns[0]];
+    if (fips.size() < 4 || fips.size() > 5)
+    {
+      continue;
+    }
+
+    // empty or malformed numbers fail the file, as read_csv fails the single file load
+    int64_t counts[3];
+    double shares[2];
+    for (size_t idx = 0; idx < 5; idx++)
+    {
+      bool valid = (idx < 3) ? parse_count(fields[columns[idx + 2]], counts[idx]) :
+        parse_number(fields[columns[idx + 2]], shares[idx - 3]);
+      if (!valid)
+      {
+        error = source.path + ": line " + std::to_string(line_number) + ": " + names[idx + 2] + " '" +
+          fields[columns[idx + 2]] + "' is not a number";
+        return false;
+      }
+    }
+
+    county_record rec;
+    rec.fips = std::string(5 - fips.size(), '0') + fips;
+    rec.name = fields[columns[1]];
+    rec.votes_gop = counts[0];
+    rec.votes_dem = counts[1];
+    rec.votes_total = counts[2];
+    rec.per_gop = shares[0];
+    rec.per_dem = shares[1];
+    rec.margin = rec.per_gop - rec.per_dem;
+    rows.push_back(std::move(rec));
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// load_election_files
+// many years in one run: the CSVs are parsed in parallel, then the results of every year are
+// replaced in one transaction through an Appender, so a failed file leaves the database as it
+// was. The aggregates are rebuilt per year after the commit, the swing rows once for the batch
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::load_election_files(const std::vector<election_file>& files, int threads)
+{
+  if (!writable("load results"))
+  {
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::set<int> years;
+  for (size_t idx = 0; idx < files.size(); idx++)
+  {
+    if (!years.insert(files[idx].year).second)
+    {
+      std::cerr << "Year " << files[idx].year << " listed more than once" << std::endl;
+      return -1;
+    }
+  }
+  if (files.empty())
+  {
+    return 0;
+  }
+
+  if (threads <= 0)
+  {
+    threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  }
+  threads = std::min(threads, static_cast<int>(files.size()));
+
+  std::vector<std::vector<county_record>> rows(files.size());
+  std::vector<std::string> errors(files.size());
+  std::vector<char> parsed(files.size(), 0);
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int idx = 0; idx < threads; idx++)
+  {
+    workers.push_back(std::thread([&]()
+    {
+      for (size_t file = next++; file < files.size(); file = next++)
+      {
+        parsed[file] = parse_election_csv(files[file], rows[file], errors[file]) ? 1 : 0;
+      }
+    }));
+  }
+  for (size_t idx = 0; idx < workers.size(); idx++)
+  {
+    workers[idx].join();
+  }
+
+  size_t total = 0;
+  for (size_t idx = 0; idx < files.size(); idx++)
+  {
+    if (!parsed[idx])
+    {
+      std::cerr << errors[idx] << std::endl;
+      return -1;
+    }
+    total += rows[idx].size();
+  }
+
+  std::chrono::steady_clock::time_point parsed_time = std::chrono::steady_clock::now();
+
+  conn->Query(R"(
+    CREATE OR REPLACE TEMP TABLE results_batch (
+      year INTEGER, county_fips VARCHAR, county_name VARCHAR, votes_gop BIGINT, votes_dem BIGINT,
+      votes_total BIGINT, per_gop DOUBLE, per_dem DOUBLE, margin DOUBLE
+    );
+  )");
+
+  // the appender throws on a bad row or a closed connection; the transaction must not stay open
+  conn->BeginTransaction();
+  try
+  {
+    {
+      duckdb::Appender appender(*conn, "results_batch");
+      for (size_t idx = 0; idx < files.size(); idx++)
+      {
+        for (size_t idx_row = 0; idx_row < rows[idx].size(); idx_row++)
+        {
+          const county_record& rec = rows[idx][idx_row];
+          appender.BeginRow();
+          appender.Append<int32_t>(files[idx].year);
+          appender.Append<duckdb::Value>(duckdb::Value(rec.fips));
+          appender.Append<duckdb::Value>(duckdb::Value(rec.name));
+          appender.Append<int64_t>(rec.votes_gop);
+          appender.Append<int64_t>(rec.votes_dem);
+          appender.Append<int64_t>(rec.votes_total);
+          appender.Append<double>(rec.per_gop);
+          appender.Append<double>(rec.per_dem);
+          appender.Append<double>(rec.margin);
+          appender.EndRow();
+        }
+      }
+      appender.Close();
+    }
+
+    std::unique_ptr<duckdb::MaterializedQueryResult> result =
+      conn->Query("DELETE FROM results WHERE year IN (SELECT DISTINCT year FROM results_batch);");
+    if (!result->HasError())
+    {
+      result = conn->Query(R"(
+        INSERT INTO results (year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin)
+        SELECT year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin
+        FROM results_batch;
+      )");
+    }
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      conn->Rollback();
+      conn->Query("DROP TABLE IF EXISTS results_batch;");
+      return -1;
+    }
+    conn->Commit();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Results load failed: " << e.what() << std::endl;
+    if (conn->HasActiveTransaction())
+    {
+      conn->Rollback();
+    }
+    conn->Query("DROP TABLE IF EXISTS results_batch;");
+    return -1;
+  }
+  conn->Query("DROP TABLE IF EXISTS results_batch;");
+
+  std::chrono::steady_clock::time_point inserted = std::chrono::steady_clock::now();
+
+  for (std::set<int>::const_iterator it = years.begin(); it != years.end(); ++it)
+  {
+    if (build_aggregates(*it) < 0)
+    {
+      return -1;
+    }
+  }
+  if (build_swing(std::vector<int>(years.begin(), years.end())) < 0)
+  {
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point aggregated = std::chrono::steady_clock::now();
+  std::cout << "Loaded " << total << " results for " << years.size() << " years from " << files.size()
+    << " files on " << threads << " threads: parse "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(parsed_time - start).count() << " ms, insert "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(inserted - parsed_time).count() << " ms, aggregate "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(aggregated - inserted).count() << " ms" << std::endl;
+  return static_cast<int>(total);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// update_results
+// upsert of live county counts; shares and margin are derived as in load_election_csv and the
+// county name of an existing row is kept. Updates must have unique (year, fips). The aggregates
+// and swing rows of the years are rebuilt in the same transaction; any failure rolls it all back
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::update_results(const std::vector<result_update>& updates)
+{
+  if (!writable("update results"))
+  {
+    return -1;
+  }
+
+  if (updates.empty())
+  {
+    return 0;
+  }
+
+  // the upsert, the aggregates and the swing rows commit together; the appender and queries can
+  // throw, which would otherwise leave the transaction open on the live thread
+  conn->BeginTransaction();
+  try
+  {
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+      CREATE OR REPLACE TEMP TABLE results_updates (
+        year INTEGER, county_fips VARCHAR, votes_gop BIGINT, votes_dem BIGINT, votes_total BIGINT
+      );
+    )");
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      conn->Rollback();
+      return -1;
+    }
+
+    {
+      duckdb::Appender appender(*conn, "results_updates");
+      for (size_t idx = 0; idx < updates.size(); idx++)
+      {
+        const result_update& u = updates[idx];
+        appender.BeginRow();
+        appender.Append<int32_t>(u.year);
+        appender.Append<duckdb::Value>(duckdb::Value(u.fips));
+        appender.Append<int64_t>(u.votes_gop);
+        appender.Append<int64_t>(u.votes_dem);
+        appender.Append<int64_t>(u.votes_total);
+        appender.EndRow();
+      }
+      appender.Close();
+    }
+
+    result = conn->Query(R"(
+      INSERT INTO results (year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin)
+      SELECT 
+        year,
+        county_fips,
+        NULL as county_name,
+        votes_gop,
+        votes_dem,
+        votes_total,
+        CASE WHEN votes_total > 0 THEN CAST(votes_gop AS DOUBLE) / votes_total ELSE 0 END as per_gop,
+        CASE WHEN votes_total > 0 THEN CAST(votes_dem AS DOUBLE) / votes_total ELSE 0 END as per_dem,
+        CASE WHEN votes_total > 0 THEN CAST(votes_gop - votes_dem AS DOUBLE) / votes_total ELSE 0 END as margin
+      FROM results_updates
+      ON CONFLICT (year, county_fips) DO UPDATE SET
+        votes_gop = EXCLUDED.votes_gop,
+        votes_dem = EXCLUDED.votes_dem,
+        votes_total = EXCLUDED.votes_total,
+        per_gop = EXCLUDED.per_gop,
+        per_dem = EXCLUDED.per_dem,
+        margin = EXCLUDED.margin;
+    )");
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      conn->Rollback();
+      return -1;
+    }
+    conn->Query("DROP TABLE IF EXISTS results_updates;");
+
+    std::set<int> years;
+    for (size_t idx = 0; idx < updates.size(); idx++)
+    {
+      years.insert(updates[idx].year);
+    }
+    for (std::set<int>::const_iterator it = years.begin(); it != years.end(); ++it)
+    {
+      if (build_aggregates(*it) < 0)
+      {
+        conn->Rollback();
+        return -1;
+      }
+    }
+    if (build_swing(std::vector<int>(years.begin(), years.end())) < 0)
+    {
+      conn->Rollback();
+      return -1;
+    }
+    conn->Commit();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Results update failed: " << e.what() << std::endl;
+    if (conn->HasActiveTransaction())
+    {
+      conn->Rollback();
+    }
+    return -1;
+  }
+  return static_cast<int>(updates.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_years
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<int> database_t::get_years()
+{
+  lease_t lease(*this);
+  std::vector<int> years;
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = lease->conn->Query("SELECT DISTINCT year FROM results ORDER BY year DESC");
+  if (result->HasError())
+  {
+    return years;
+  }
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < chunk->size(); idx++)
+    {
+      years.push_back(chunk->GetValue(0, idx).GetValue<int>());
+    }
+  }
+
+  return years;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// stream_counties, read_counties, read_states, read_national
+// the year queries on a checked out connection, with its prepared statements. County rows are
+// streamed: the prepared statement returns a StreamQueryResult, converted one chunk at a time
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool stream_counties(connection_t& connection, int year, int level, const database_t::county_callback_t& callback)
+{
+  duckdb::PreparedStatement* statement = (level < 0) ?
+    prepare(*connection.conn, connection.stmt_counties, sql_counties) :
+    prepare(*connection.conn, connection.stmt_county_geometry, sql_county_geometry);
+  if (!statement)
+  {
+    return false;
+  }
+
+  std::vector<duckdb::Value> values;
+  values.push_back(duckdb::Value::INTEGER(year));
+  if (level >= 0)
+  {
+    values.push_back(duckdb::Value::INTEGER(level));
+  }
+  std::unique_ptr<duckdb::QueryResult> result = statement->Execute(values, true);
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return false;
+  }
+
+  bool columnar = has_types(*result, county_types);
+  std::vector<county_record> records;
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr && chunk->size() > 0)
+  {
+    records.clear();
+    if (columnar)
+    {
+      append_counties_columnar(*chunk, records);
+    }
+    else
+    {
+      append_counties_values(*chunk, records);
+    }
+    if (!callback(records))
+    {
+      break;
+    }
+  }
+  return !result->HasError();
+}
+
+static std::vector<county_record> read_counties(connection_t& connection, int year, int level)
+{
+  std::vector<county_record> records;
+  stream_counties(connection, year, level, [&records](const std::vector<county_record>& rows)
+  {
+    records.insert(records.end(), rows.begin(), rows.end());
+    return true;
+  });
+  return records;
+}
+
+static std::vector<state_record> read_states(connection_t& connection, int year)
+{
+  std::vector<state_record> records;
+
+  duckdb::PreparedStatement* statement = prepare(*connection.conn, connection.stmt_states, sql_states);
+  if (!statement)
+  {
+    return records;
+  }
+
+  std::unique_ptr<duckdb::QueryResult> result = statement->Execute(duckdb::Value::INTEGER(year));
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return records;
+  }
+
+  bool columnar = has_types(*result, state_types);
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr)
+  {
+    if (columnar)
+    {
+      append_states_columnar(*chunk, records);
+    }
+    else
+    {
+      append_states_values(*chunk, records);
+    }
+  }
+
+  return records;
+}
+
+static national_record read_national(connection_t& connection, int year)
+{
+  national_record rec;
+  duckdb::PreparedStatement* statement = prepare(*connection.conn, connection.stmt_national, sql_national);
+  if (!statement) return rec;
+  std::unique_ptr<duckdb::QueryResult> result = statement->Execute(duckdb::Value::INTEGER(year));
+  if (result->HasError()) return rec;
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk = result->Fetch();
+  if (chunk && chunk->size() > 0)
+  {
+    rec.votes_gop = chunk->GetValue(0, 0).GetValue<int64_t>();
+    rec.votes_dem = chunk->GetValue(1, 0).GetValue<int64_t>();
+    rec.votes_total = chunk->GetValue(2, 0).GetValue<int64_t>();
+  }
+  return rec;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_counties
+// a negative level leaves the geometry out (year payloads); otherwise the stored GeoJSON of it
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+county_table_t database_t::get_counties(int year, int level)
+{
+  county_table_t table;
+  stream_counties(year, level, [&](const std::vector<county_record>& rows)
+  {
+    for (size_t idx = 0; idx < rows.size(); idx++)
+    {
+      table.append(rows[idx]);
+    }
+    return true;
+  });
+
+  if (table.size() > 0)
+  {
+    std::cout << "First 3 counties for year " << year << ":" << std::endl;
+    for (size_t idx = 0; idx < 3 && idx < table.size(); idx++)
+    {
+      std::cout << "  FIPS: " << table.fips(idx)
+        << ", Name: [" << table.name(idx) << "]"
+        << ", State: [" << table.state_name(idx) << "]" << std::endl;
+    }
+  }
+
+  return table;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// stream_counties
+// county rows of a year one result chunk at a time (at most 2048 rows), as get_counties; the
+// callback returns false to stop. Peak memory is one chunk, not the year
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool database_t::stream_counties(int year, int level, const county_callback_t& callback)
+{
+  lease_t lease(*this);
+  return ::stream_counties(*lease, year, level, callback);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// stream_query
+// any query, prepared with its parameters and executed as a StreamQueryResult; the callback gets
+// each chunk flattened and returns false to stop
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool database_t::stream_query(const std::string& sql, std::vector<duckdb::Value> values, const chunk_callback_t& callback)
+{
+  lease_t lease(*this);
+  std::unique_ptr<duckdb::PreparedStatement> statement = lease->conn->Prepare(sql);
+  if (statement->HasError())
+  {
+    std::cerr << statement->GetError() << std::endl;
+    return false;
+  }
+  std::unique_ptr<duckdb::QueryResult> result = statement->Execute(values, true);
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return false;
+  }
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr && chunk->size() > 0)
+  {
+    chunk->Flatten();
+    if (!callback(*result, *chunk))
+    {
+      break;
+    }
+  }
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_states
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<state_record> database_t::get_states(int year)
+{
+  lease_t lease(*this);
+  return read_states(*lease, year);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_national
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+national_record database_t::get_national(int year)
+{
+  lease_t lease(*this);
+  return read_national(*lease, year);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_swing
+// county_swing rows of a year pair, as stored at load time; empty when either year is not loaded
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<swing_record> database_t::get_swing(int year, int base_year)
+{
+  std::vector<swing_record> records;
+  lease_t lease(*this);
+  std::unique_ptr<duckdb::QueryResult> result = lease->conn->Query(R"(
+    SELECT county_fips, margin_shift, per_gop_shift, per_dem_shift, COALESCE(turnout_change, 0), votes_total_change
+    FROM county_swing
+    WHERE year = $1 AND base_year = $2
+    ORDER BY county_fips
+  )", duckdb::Value::INTEGER(year), duckdb::Value::INTEGER(base_year));
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return records;
+  }
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < chunk->size(); idx++)
+    {
+      swing_record rec;
+      rec.fips = chunk->GetValue(0, idx).ToString();
+      rec.margin_shift = chunk->GetValue(1, idx).GetValue<double>();
+      rec.per_gop_shift = chunk->GetValue(2, idx).GetValue<double>();
+      rec.per_dem_shift = chunk->GetValue(3, idx).GetValue<double>();
+      rec.turnout_change = chunk->GetValue(4, idx).GetValue<double>();
+      rec.votes_total_change = chunk->GetValue(5, idx).GetValue<int64_t>();
+      records.push_back(rec);
+    }
+  }
+  return records;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_shapes
+// decoded county geometry at a simplification level; names from the most recent year with results
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<shape_t> database_t::get_shapes(int level)
+{
+  lease_t lease(*this);
+  std::vector<shape_t> shapes;
+
+  duckdb::PreparedStatement* statement = prepare(*lease->conn, lease->stmt_shapes, sql_shapes);
+  if (!statement)
+  {
+    return shapes;
+  }
+
+  std::unique_ptr<duckdb::QueryResult> result = statement->Execute(duckdb::Value::INTEGER(level));
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return shapes;
+  }
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < chunk->size(); idx++)
+    {
+      shape_t shape;
+      shape.fips = chunk->GetValue(0, idx).ToString();
+
+      duckdb::Value name_val = chunk->GetValue(1, idx);
+      if (!name_val.IsNull())
+      {
+        shape.name = name_val.ToString();
+      }
+      shape.state_name = chunk->GetValue(2, idx).ToString();
+
+      duckdb::Value wkb_val = chunk->GetValue(3, idx);
+      const std::string& wkb = duckdb::StringValue::Get(wkb_val);
+      if (!read_wkb(wkb.data(), wkb.size(), shape.polygons))
+      {
+        std::cerr << "Invalid geometry for county " << shape.fips << std::endl;
+        continue;
+      }
+      shape.bbox = bounding_box(shape.polygons);
+      shapes.push_back(std::move(shape));
+    }
+  }
+
+  return shapes;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_state_shapes
+// decoded state boundaries, from the TopoJSON states layer or dissolved from counties
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<shape_t> database_t::get_state_shapes()
+{
+  lease_t lease(*this);
+  std::vector<shape_t> shapes;
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = lease->conn->Query(R"(
+    SELECT 
+      s.fips,
+      COALESCE(n.name, s.name) as name,
+      ST_AsWKB(s.geometry) as wkb
+    FROM states s
+    LEFT JOIN state_names n ON s.fips = n.fips
+    WHERE s.geometry IS NOT NULL
+    ORDER BY s.fips
+  )");
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return shapes;
+  }
+
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < chunk->size(); idx++)
+    {
+      shape_t shape;
+      shape.fips = chunk->GetValue(0, idx).ToString();
+      duckdb::Value name_val = chunk->GetValue(1, idx);
+      if (!name_val.IsNull())
+      {
+        shape.name = name_val.ToString();
+      }
+
+      duckdb::Value wkb_val = chunk->GetValue(2, idx);
+      const std::string& wkb = duckdb::StringValue::Get(wkb_val);
+      if (!read_wkb(wkb.data(), wkb.size(), shape.polygons))
+      {
+        std::cerr << "Invalid geometry for state " << shape.fips << std::endl;
+        continue;
+      }
+      shape.bbox = bounding_box(shape.polygons);
+      shapes.push_back(std::move(shape));
+    }
+  }
+
+  return shapes;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_states
+// state boundaries are computed once at load time: a GeoJSON source has no states layer, so
+// county geometries are dissolved per state; names come from state_names in both cases
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::build_states()
+{
+  if (!writable("build states"))
+  {
+    return -1;
+  }
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query("SELECT COUNT(*) FROM states;");
+  if (count_result->HasError())
+  {
+    std::cerr << count_result->GetError() << std::endl;
+    return -1;
+  }
+  duckdb::unique_ptr<duckdb::DataChunk> chunk = count_result->Fetch();
+  int64_t count = (chunk && chunk->size() > 0) ? chunk->GetValue(0, 0).GetValue<int64_t>() : 0;
+
+  if (count == 0)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+      INSERT INTO states (fips, name, geometry)
+      SELECT 
+        state_fips as fips,
+        '' as name,
+        ST_Union_Agg(geometry) as geometry
+      FROM counties
+      WHERE geometry IS NOT NULL
+      GROUP BY state_fips
+    )");
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      return -1;
+    }
+    std::cout << "Dissolved county geometry into states in "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+      << " ms" << std::endl;
+  }
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+    UPDATE states SET name = n.name FROM state_names n WHERE states.fips = n.fips
+  )");
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return -1;
+  }
+
+  count_result = conn->Query("SELECT COUNT(*) FROM states;");
+  chunk = count_result->HasError() ? nullptr : count_result->Fetch();
+  count = (chunk && chunk->size() > 0) ? chunk->GetValue(0, 0).GetValue<int64_t>() : 0;
+  std::cout << "Loaded " << count << " states" << std::endl;
+  return static_cast<int>(count);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_aggregates
+// state_results and national_results of a year, replaced whenever the year's results change, so
+// sessions read precomputed rows instead of grouping every county. States are summed over their
+// counties, as the map shows them; the national row over all results of the year
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::build_aggregates(int year)
+{
+  if (!writable("build aggregates"))
+  {
+    return -1;
+  }
+
+  duckdb::Value year_value = duckdb::Value::INTEGER(year);
+
+  // joins the caller's transaction when there is one, which then commits or rolls back
+  bool own = !conn->HasActiveTransaction();
+  if (own) conn->BeginTransaction();
+  conn->Query("DELETE FROM state_results WHERE year = $1", year_value);
+  conn->Query("DELETE FROM national_results WHERE year = $1", year_value);
+
+  std::unique_ptr<duckdb::QueryResult> result = conn->Query(R"(
+    INSERT INTO state_results (year, state_fips, votes_gop, votes_dem, votes_total)
+    SELECT 
+      CAST($1 AS INTEGER) as year,
+      c.state_fips,
+      SUM(COALESCE(r.votes_gop, 0)),
+      SUM(COALESCE(r.votes_dem, 0)),
+      SUM(COALESCE(r.votes_total, 0))
+    FROM counties c
+    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = $1
+    WHERE c.state_fips IS NOT NULL
+    GROUP BY c.state_fips
+  )", year_value);
+  if (!result->HasError())
+  {
+    result = conn->Query(R"(
+      INSERT INTO national_results (year, votes_gop, votes_dem, votes_total)
+      SELECT 
+        CAST($1 AS INTEGER) as year,
+        COALESCE(SUM(votes_gop), 0),
+        COALESCE(SUM(votes_dem), 0),
+        COALESCE(SUM(votes_total), 0)
+      FROM results
+      WHERE year = $1
+    )", year_value);
+  }
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    if (own) conn->Rollback();
+    return -1;
+  }
+  if (own) conn->Commit();
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_swing
+// county_swing rows between each of the years and every other loaded year. One row per county
+// and pair, stored in one direction only: year is always the later election, base_year the
+// earlier. One self-join of results on the county, run vectorized by DuckDB; replaced whenever
+// the years' results change, as the aggregates are. A batch of years is passed at once, so a
+// pair of two years in it is computed once. Counties missing from either year (redrawn FIPS)
+// have no row
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::build_swing(int year)
+{
+  return build_swing(std::vector<int>(1, year));
+}
+
+int database_t::build_swing(const std::vector<int>& years)
+{
+  if (!writable("build swing"))
+  {
+    return -1;
+  }
+  if (years.empty())
+  {
+    return 0;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // years are integers, so the list is safe to splice, as in import_parquet
+  std::string year_list;
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    year_list += (idx == 0 ? "" : ", ") + std::to_string(years[idx]);
+  }
+
+  // joins the caller's transaction when there is one, as build_aggregates does
+  bool own = !conn->HasActiveTransaction();
+  if (own) conn->BeginTransaction();
+  conn->Query("DELETE FROM county_swing WHERE year IN (" + year_list + ") OR base_year IN (" + year_list + ");");
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+    INSERT INTO county_swing (year, base_year, county_fips, margin_shift, per_gop_shift, per_dem_shift,
+      turnout_change, votes_total_change)
+    SELECT
+      r.year,
+      b.year,
+      r.county_fips,
+      r.margin - b.margin,
+      r.per_gop - b.per_gop,
+      r.per_dem - b.per_dem,
+      CASE WHEN b.votes_total > 0 THEN CAST(r.votes_total AS DOUBLE) / b.votes_total - 1 END,
+      r.votes_total - b.votes_total
+    FROM results r
+    JOIN results b ON b.county_fips = r.county_fips AND b.year < r.year
+    WHERE r.year IN ()" + year_list + R"() OR b.year IN ()" + year_list + R"()
+  )");
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    if (own) conn->Rollback();
+    return -1;
+  }
+  if (own) conn->Commit();
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query(R"(
+    SELECT CAST(COALESCE(SUM(n), 0) AS BIGINT), COUNT(*) FROM (
+      SELECT COUNT(*) as n FROM county_swing
+      WHERE year IN ()" + year_list + R"() OR base_year IN ()" + year_list + R"()
+      GROUP BY year, base_year
+    )
+  )");
+  duckdb::unique_ptr<duckdb::DataChunk> chunk = count_result->HasError() ? nullptr : count_result->Fetch();
+  if (chunk && chunk->size() > 0 && chunk->GetValue(0, 0).GetValue<int64_t>() > 0)
+  {
+    std::cout << "Swing " << year_list << ": " << chunk->GetValue(0, 0).GetValue<int64_t>() << " counties over "
+      << chunk->GetValue(1, 0).GetValue<int64_t>() << " year pairs in "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+      << " ms" << std::endl;
+  }
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_levels
+// simplified copies of the county geometry, one row per county and level above 0. Simplification
+// runs on a shared-arc topology so neighbouring counties keep identical borders; a county whose
+// simplified geometry collapses gets no row and falls back to the source geometry
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::build_levels()
+{
+  if (!writable("build levels"))
+  {
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<shape_t> shapes = get_shapes();
+  if (shapes.empty())
+  {
+    return -1;
+  }
+
+  topology_t topology = build_topology(shapes, 10000000);
+
+  size_t source_points = 0;
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    source_points += count_points(shapes[idx].polygons);
+  }
+  std::cout << "Topology: " << shapes.size() << " counties, " << source_points << " points, "
+    << topology.arcs.size() << " arcs, " << count_arc_points(topology) << " arc points" << std::endl;
+
+  conn->Query("DELETE FROM county_levels;");
+  conn->Query("CREATE OR REPLACE TEMP TABLE county_levels_wkb (fips VARCHAR, level INTEGER, wkb BLOB);");
+
+  int rows = 0;
+  duckdb::Appender appender(*conn, "county_levels_wkb");
+  for (int idx_level = 0; idx_level < geometry_level_count; idx_level++)
+  {
+    const geometry_level& level = geometry_levels[idx_level];
+    if (level.level == 0)
+    {
+      continue;
+    }
+
+    topology_t simplified = simplify_topology(topology, level.tolerance);
+    size_t points = 0;
+    for (size_t idx = 0; idx < shapes.size(); idx++)
+    {
+      multipolygon_t polygons = topology_polygons(simplified, idx, level.decimals);
+      if (polygons.empty())
+      {
+        continue;
+      }
+      points += count_points(polygons);
+
+      std::string wkb = write_wkb(polygons);
+      appender.BeginRow();
+      appender.Append<duckdb::Value>(duckdb::Value(shapes[idx].fips));
+      appender.Append<int32_t>(level.level);
+      appender.Append<duckdb::Value>(duckdb::Value::BLOB(
+        reinterpret_cast<duckdb::const_data_ptr_t>(wkb.data()), wkb.size()));
+      appender.EndRow();
+      rows++;
+    }
+
+    std::cout << "Level " << level.level << " (zoom <= " << level.max_zoom << ", tolerance "
+      << level.tolerance << ", " << level.decimals << " decimals): " << points << " points" << std::endl;
+  }
+  appender.Close();
+
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+    INSERT INTO county_levels (fips, level, geometry)
+    SELECT fips, level, ST_GeomFromWKB(wkb) FROM county_levels_wkb;
+  )");
+  conn->Query("DROP TABLE IF EXISTS county_levels_wkb;");
+
+  if (result->HasError())
+  {
+    std::cerr << result->GetError() << std::endl;
+    return -1;
+  }
+
+  std::cout << "Saved " << rows << " simplified geometries in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+
+  if (build_geojson() < 0)
+  {
+    return -1;
+  }
+  return rows;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_geojson
+// county geometry serialized once per level into county_geojson: level 0 from counties, the
+// others from county_levels, whose coordinates are already rounded to the level's decimals.
+// Geometry does not change between years, so get_counties selects the stored text
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::build_geojson()
+{
+  if (!writable("build GeoJSON"))
+  {
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  conn->BeginTransaction();
+  conn->Query("DELETE FROM county_geojson;");
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(R"(
+    INSERT INTO county_geojson (fips, level, geojson)
+    SELECT fips, 0, ST_AsGeoJSON(geometry) FROM counties WHERE geometry IS NOT NULL
+    UNION ALL
+    SELECT fips, level, ST_AsGeoJSON(geometry) FROM county_levels WHERE geometry IS NOT NULL;
+  )");
   if (result->HasError())
   {
     std::cerr << result->GetError() << std::endl;
+    conn->Rollback();
     return -1;
   }
+  conn->Commit();
 
-  std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query("SELECT COUNT(*) FROM results WHERE year = " + std::to_string(year));
+  int64_t rows = 0;
+  std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query("SELECT COUNT(*), COALESCE(SUM(LENGTH(geojson)), 0) FROM county_geojson;");
   if (!count_result->HasError())
   {
     duckdb::unique_ptr<duckdb::DataChunk> chunk = count_result->Fetch();
     if (chunk && chunk->size() > 0)
     {
-      int64_t count = chunk->GetValue(0, 0).GetValue<int64_t>();
-      std::cout << "Loaded " << count << " results for " << year << std::endl;
-      return static_cast<int>(count);
+      rows = chunk->GetValue(0, 0).GetValue<int64_t>();
+      std::cout << "Stored GeoJSON: " << rows << " geometries, " << chunk->GetValue(1, 0).GetValue<int64_t>()
+        << " bytes in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+        << " ms" << std::endl;
     }
   }
+  return static_cast<int>(rows);
+}
 
-  return 0;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// save_tiles
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int database_t::save_tiles(const std::vector<tile_record>& tiles)
+{
+  if (!writable("save tiles"))
+  {
+    return -1;
+  }
+
+  conn->Query("DELETE FROM tiles;");
+
+  duckdb::Appender appender(*conn, "tiles");
+  for (size_t idx = 0; idx < tiles.size(); idx++)
+  {
+    const tile_record& t = tiles[idx];
+    appender.BeginRow();
+    appender.Append<int32_t>(t.z);
+    appender.Append<int32_t>(t.x);
+    appender.Append<int32_t>(t.y);
+    appender.Append<duckdb::Value>(duckdb::Value::BLOB(
+      reinterpret_cast<duckdb::const_data_ptr_t>(t.data.data()), t.data.size()));
+    appender.EndRow();
+  }
+  appender.Close();
+
+  std::cout << "Saved " << tiles.size() << " tiles" << std::endl;
+  return static_cast<int>(tiles.size());
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-// get_years
+// get_tiles
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-std::vector<int> database_t::get_years()
+std::vector<tile_record> database_t::get_tiles()
 {
-  std::vector<int> years;
+  lease_t lease(*this);
+  std::vector<tile_record> tiles;
 
-  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query("SELECT DISTINCT year FROM results ORDER BY year DESC");
+  std::unique_ptr<duckdb::MaterializedQueryResult> result = lease->conn->Query("SELECT z, x, y, data FROM tiles");
   if (result->HasError())
   {
-    return years;
+    return tiles;
   }
 
   duckdb::unique_ptr<duckdb::DataChunk> chunk;
@@ -263,223 +2119,369 @@ std::vector<int> database_t::get_years()
   {
     for (size_t idx = 0; idx < chunk->size(); idx++)
     {
-      years.push_back(chunk->GetValue(0, idx).GetValue<int>());
+      tile_record t;
+      t.z = chunk->GetValue(0, idx).GetValue<int>();
+      t.x = chunk->GetValue(1, idx).GetValue<int>();
+      t.y = chunk->GetValue(2, idx).GetValue<int>();
+      t.data = duckdb::StringValue::Get(chunk->GetValue(3, idx));
+      tiles.push_back(std::move(t));
     }
   }
 
-  return years;
+  return tiles;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-// get_counties
+// export_geojson
+// written to output_path.tmp and renamed into place, so a failed export leaves no partial file
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-std::vector<county_record> database_t::get_counties(int year)
+int database_t::export_geojson(int year, const std::string& output_path, int decimals)
 {
-  std::vector<county_record> records;
+  std::string temp = output_path + ".tmp";
+  std::ofstream file(temp, std::ios::binary);
+  if (!file.is_open())
+  {
+    return -1;
+  }
 
-  std::string sql = R"(
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  static const std::vector<duckdb::PhysicalType> export_types =
+  {
+    duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR, duckdb::PhysicalType::VARCHAR,
+    duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64, duckdb::PhysicalType::INT64,
+    duckdb::PhysicalType::DOUBLE, duckdb::PhysicalType::DOUBLE, duckdb::PhysicalType::DOUBLE,
+    duckdb::PhysicalType::VARCHAR
+  };
+
+  // geometry is written from WKB at the requested precision, as the rows stream in; the buffer is
+  // flushed every 1 MB, so memory is bounded by a chunk and the buffer, not by the year
+  json_writer_t writer(2 * 1024 * 1024, decimals);
+  size_t bytes = 0;
+  int count = 0;
+  bool valid = true;
+  writer.begin_object();
+  writer.key("type").value("FeatureCollection");
+  writer.key("features").begin_array();
+
+  std::vector<duckdb::Value> values;
+  values.push_back(duckdb::Value::INTEGER(year));
+  bool streamed = stream_query(R"(
     SELECT 
       c.fips,
       COALESCE(r.county_name, c.name) as name,
       COALESCE(s.name, '') as state_name,
-      c.state_fips,
       COALESCE(r.votes_gop, 0) as votes_gop,
       COALESCE(r.votes_dem, 0) as votes_dem,
       COALESCE(r.votes_total, 0) as votes_total,
       COALESCE(r.per_gop, 0) as per_gop,
       COALESCE(r.per_dem, 0) as per_dem,
       COALESCE(r.margin, 0) as margin,
-      ST_AsGeoJSON(c.geometry) as geojson
+      ST_AsWKB(c.geometry) as wkb
     FROM counties c
-    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = )" + std::to_string(year) + R"(
+    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = $1
     LEFT JOIN state_names s ON c.state_fips = s.fips
+    WHERE c.geometry IS NOT NULL
     ORDER BY c.fips
-  )";
-
-  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(sql);
-  if (result->HasError())
-  {
-    std::cerr << result->GetError() << std::endl;
-    return records;
-  }
-
-  duckdb::unique_ptr<duckdb::DataChunk> chunk;
-  while ((chunk = result->Fetch()) != nullptr)
+  )", values, [&](duckdb::QueryResult& result, duckdb::DataChunk& chunk)
   {
-    for (size_t idx = 0; idx < chunk->size(); idx++)
+    if (!has_types(result, export_types))
     {
-      county_record rec;
-      rec.fips = chunk->GetValue(0, idx).ToString();
-
-      duckdb::Value name_val = chunk->GetValue(1, idx);
-      if (name_val.IsNull())
-      {
-        rec.name = "";
-      }
-      else
-      {
-        rec.name = name_val.ToString();
-      }
+      std::cerr << "Unexpected column types for the export" << std::endl;
+      valid = false;
+      return false;
+    }
 
-      duckdb::Value state_val = chunk->GetValue(2, idx);
-      if (state_val.IsNull())
+    string_column_t fips(chunk.data[0]);
+    string_column_t name(chunk.data[1]);
+    string_column_t state_name(chunk.data[2]);
+    column_t<int64_t> votes_gop(chunk.data[3]);
+    column_t<int64_t> votes_dem(chunk.data[4]);
+    column_t<int64_t> votes_total(chunk.data[5]);
+    column_t<double> per_gop(chunk.data[6]);
+    column_t<double> per_dem(chunk.data[7]);
+    column_t<double> margin(chunk.data[8]);
+    string_column_t wkb(chunk.data[9]);
+
+    std::string fips_str, name_str, state_str, wkb_str;
+    multipolygon_t polygons;
+    for (size_t idx = 0; idx < chunk.size(); idx++)
+    {
+      fips.get(idx, fips_str);
+      wkb.get(idx, wkb_str);
+      polygons.clear();
+      if (!read_wkb(wkb_str.data(), wkb_str.size(), polygons))
       {
-        rec.state_name = "";
+        std::cerr << "Invalid geometry for county " << fips_str << std::endl;
+        continue;
       }
-      else
+      name.get(idx, name_str);
+      state_name.get(idx, state_str);
+
+      writer.begin_object();
+      writer.key("type").value("Feature");
+      writer.key("id").value(fips_str);
+      writer.key("properties").begin_object();
+      writer.key("fips").value(fips_str);
+      writer.key("name").value(name_str);
+      writer.key("state").value(state_str);
+      writer.key("gop").value(votes_gop.get(idx));
+      writer.key("dem").value(votes_dem.get(idx));
+      writer.key("total").value(votes_total.get(idx));
+      writer.key("per_gop").value(per_gop.get(idx));
+      writer.key("per_dem").value(per_dem.get(idx));
+      writer.key("margin").value(margin.get(idx));
+      writer.end_object();
+      writer.key("geometry");
+      write_geojson_geometry(writer, polygons);
+      writer.end_object();
+      count++;
+
+      if (writer.size() > 1024 * 1024)
       {
-        rec.state_name = state_val.ToString();
+        bytes += writer.size();
+        writer.flush(file);
       }
-
-      rec.state_fips = chunk->GetValue(3, idx).ToString();
-      rec.votes_gop = chunk->GetValue(4, idx).GetValue<int64_t>();
-      rec.votes_dem = chunk->GetValue(5, idx).GetValue<int64_t>();
-      rec.votes_total = chunk->GetValue(6, idx).GetValue<int64_t>();
-      rec.per_gop = chunk->GetValue(7, idx).GetValue<double>();
-      rec.per_dem = chunk->GetValue(8, idx).GetValue<double>();
-      rec.margin = chunk->GetValue(9, idx).GetValue<double>();
-      rec.geojson = chunk->GetValue(10, idx).ToString();
-      records.push_back(rec);
     }
+    return true;
+  });
+  std::error_code error;
+  if (!streamed || !valid)
+  {
+    file.close();
+    std::filesystem::remove(temp, error);
+    return -1;
   }
 
-  if (records.size() > 0)
+  writer.end_array();
+  writer.end_object();
+  writer.raw("\n");
+  bytes += writer.size();
+  writer.flush(file);
+  file.close();
+  if (!file)
   {
-    std::cout << "First 3 counties for year " << year << ":" << std::endl;
-    for (size_t idx = 0; idx < 3 && idx < records.size(); idx++)
-    {
-      std::cout << "  FIPS: " << records[idx].fips
-        << ", Name: [" << records[idx].name << "]"
-        << ", State: [" << records[idx].state_name << "]" << std::endl;
-    }
+    std::cerr << "Cannot write " << temp << std::endl;
+    std::filesystem::remove(temp, error);
+    return -1;
+  }
+  std::filesystem::rename(temp, output_path, error);
+  if (error)
+  {
+    std::cerr << "Cannot rename " << temp << " to " << output_path << ": " << error.message() << std::endl;
+    std::filesystem::remove(temp, error);
+    return -1;
   }
 
-  return records;
+  std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Exported " << count << " counties to " << output_path << ": " << bytes << " bytes, streamed in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms ("
+    << megabytes_per_second(bytes, elapsed) << " MB/s)" << std::endl;
+  return count;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-// get_states
+// export_parquet
+// counties, states, county_levels and results as one Parquet file each in a directory, geometry
+// as WKB. Results are sorted by year and written in row groups of about a year of counties, so
+// the min/max statistics of each group let a year filter skip the others
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-std::vector<state_record> database_t::get_states(int year)
+int database_t::export_parquet(const std::string& directory)
 {
-  std::vector<state_record> records;
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error)
+  {
+    std::cerr << "Cannot create " << directory << ": " << error.message() << std::endl;
+    return -1;
+  }
 
-  std::string sql = R"(
-    SELECT 
-      c.state_fips as fips,
-      s.name as state_name,
-      SUM(COALESCE(r.votes_gop, 0)) as votes_gop,
-      SUM(COALESCE(r.votes_dem, 0)) as votes_dem,
-      SUM(COALESCE(r.votes_total, 0)) as votes_total
-    FROM counties c
-    LEFT JOIN results r ON c.fips = r.county_fips AND r.year = )" + std::to_string(year) + R"(
-    LEFT JOIN state_names s ON c.state_fips = s.fips
-    GROUP BY c.state_fips, s.name
-    ORDER BY s.name
-  )";
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(sql);
-  if (result->HasError())
+  static const char* exports[][2] =
   {
-    std::cerr << result->GetError() << std::endl;
-    return records;
-  }
+    { "counties.parquet", "SELECT fips, name, state_fips, CAST(ST_AsWKB(geometry) AS BLOB) as geometry FROM counties ORDER BY fips" },
+    { "states.parquet", "SELECT fips, name, CAST(ST_AsWKB(geometry) AS BLOB) as geometry FROM states ORDER BY fips" },
+    { "county_levels.parquet", "SELECT fips, level, CAST(ST_AsWKB(geometry) AS BLOB) as geometry FROM county_levels ORDER BY level, fips" },
+    { "results.parquet", "SELECT year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin FROM results ORDER BY year, county_fips" }
+  };
 
-  duckdb::unique_ptr<duckdb::DataChunk> chunk;
-  while ((chunk = result->Fetch()) != nullptr)
+  int64_t total = 0;
+  for (size_t idx = 0; idx < sizeof(exports) / sizeof(exports[0]); idx++)
   {
-    for (size_t idx = 0; idx < chunk->size(); idx++)
+    std::string path = (std::filesystem::path(directory) / exports[idx][0]).string();
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(std::string("COPY (") + exports[idx][1] + ") TO " +
+      sql_string(path) + " (FORMAT PARQUET, COMPRESSION ZSTD, ROW_GROUP_SIZE 4096);");
+    if (result->HasError())
     {
-      state_record rec;
-      rec.fips = chunk->GetValue(0, idx).ToString();
-      rec.name = chunk->GetValue(1, idx).ToString();
-      rec.votes_gop = chunk->GetValue(2, idx).GetValue<int64_t>();
-      rec.votes_dem = chunk->GetValue(3, idx).GetValue<int64_t>();
-      rec.votes_total = chunk->GetValue(4, idx).GetValue<int64_t>();
-      rec.per_gop = (rec.votes_total > 0) ? static_cast<double>(rec.votes_gop) / rec.votes_total : 0.0;
-      rec.per_dem = (rec.votes_total > 0) ? static_cast<double>(rec.votes_dem) / rec.votes_total : 0.0;
-      rec.winner = (rec.votes_gop > rec.votes_dem) ? "GOP" : "DEM";
-      records.push_back(rec);
+      std::cerr << result->GetError() << std::endl;
+      return -1;
     }
+
+    duckdb::unique_ptr<duckdb::DataChunk> chunk = result->Fetch();
+    int64_t rows = (chunk && chunk->size() > 0) ? chunk->GetValue(0, 0).GetValue<int64_t>() : 0;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    std::cout << "Wrote " << path << ": " << rows << " rows, " << (error ? 0 : size) << " bytes" << std::endl;
+    total += rows;
   }
 
-  return records;
+  std::cout << "Exported " << total << " rows in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+  return static_cast<int>(total);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
-// get_total_votes
+// import_parquet
+// reads a directory written by export_parquet. Results replace the years they contain, or only
+// the listed years: the filter and the column list are pushed into the Parquet scan, so row groups
+// of other years and unused columns are not read. When counties.parquet is present the geometry
+// is replaced too, in the same transaction; states missing from the directory are dissolved and
+// missing levels rebuilt, as after load_topojson
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int64_t database_t::get_total_votes(int year)
+int database_t::import_parquet(const std::string& directory, const std::vector<int>& years)
 {
-  std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query("SELECT SUM(votes_total) FROM results WHERE year = " + std::to_string(year));
-  if (result->HasError()) return 0;
-
-  duckdb::unique_ptr<duckdb::DataChunk> chunk = result->Fetch();
-  if (chunk && chunk->size() > 0)
+  if (!writable("import Parquet"))
   {
-    return chunk->GetValue(0, 0).GetValue<int64_t>();
+    return -1;
   }
-  return 0;
-}
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-// export_geojson
-/////////////////////////////////////////////////////////////////////////////////////////////////////
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-int database_t::export_geojson(int year, const std::string& output_path)
-{
-  std::ofstream file(output_path);
-  if (!file.is_open())
+  std::filesystem::path dir(directory);
+  std::string results_path = (dir / "results.parquet").string();
+  std::string counties_path = (dir / "counties.parquet").string();
+  std::string states_path = (dir / "states.parquet").string();
+  std::string levels_path = (dir / "county_levels.parquet").string();
+  if (!std::filesystem::exists(results_path))
   {
+    std::cerr << "No results.parquet in " << directory << std::endl;
     return -1;
   }
+  bool geometry = std::filesystem::exists(counties_path);
+  bool states = geometry && std::filesystem::exists(states_path);
+  bool levels = geometry && std::filesystem::exists(levels_path);
 
-  std::vector<county_record> counties = get_counties(year);
+  std::string filter;
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    filter += (idx == 0 ? " WHERE year IN (" : ", ") + std::to_string(years[idx]);
+  }
+  if (!years.empty())
+  {
+    filter += ")";
+  }
 
-  file << "{\"type\":\"FeatureCollection\",\"features\":[\n";
+  // the years in the file, from the year column alone
+  std::unique_ptr<duckdb::MaterializedQueryResult> years_result = conn->Query(
+    "SELECT DISTINCT year FROM read_parquet(" + sql_string(results_path) + ")" + filter + " ORDER BY year;");
+  if (years_result->HasError())
+  {
+    std::cerr << years_result->GetError() << std::endl;
+    return -1;
+  }
+  std::vector<int> imported;
+  std::string imported_list;
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = years_result->Fetch()) != nullptr)
+  {
+    for (size_t idx = 0; idx < chunk->size(); idx++)
+    {
+      imported.push_back(chunk->GetValue(0, idx).GetValue<int>());
+      imported_list += (imported.size() == 1 ? "" : ", ") + std::to_string(imported.back());
+    }
+  }
+  if (imported.empty())
+  {
+    std::cerr << "No results to import from " << results_path << std::endl;
+    return -1;
+  }
 
-  bool first = true;
-  for (size_t idx = 0; idx < counties.size(); idx++)
+  std::vector<std::string> statements;
+  if (geometry)
+  {
+    statements.push_back("DELETE FROM counties;");
+    statements.push_back("DELETE FROM states;");
+    statements.push_back("DELETE FROM tiles;");
+    statements.push_back("DELETE FROM county_levels;");
+    statements.push_back(
+      "INSERT INTO counties (fips, name, state_fips, geometry) "
+      "SELECT fips, name, state_fips, ST_GeomFromWKB(geometry) FROM read_parquet(" + sql_string(counties_path) + ");");
+    if (states)
+    {
+      statements.push_back(
+        "INSERT INTO states (fips, name, geometry) "
+        "SELECT fips, name, ST_GeomFromWKB(geometry) FROM read_parquet(" + sql_string(states_path) + ");");
+    }
+    if (levels)
+    {
+      statements.push_back(
+        "INSERT INTO county_levels (fips, level, geometry) "
+        "SELECT fips, level, ST_GeomFromWKB(geometry) FROM read_parquet(" + sql_string(levels_path) + ");");
+    }
+  }
+  statements.push_back("DELETE FROM results WHERE year IN (" + imported_list + ");");
+  statements.push_back(
+    "INSERT INTO results (year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin) "
+    "SELECT year, county_fips, county_name, votes_gop, votes_dem, votes_total, per_gop, per_dem, margin "
+    "FROM read_parquet(" + sql_string(results_path) + ") WHERE year IN (" + imported_list + ");");
+
+  conn->BeginTransaction();
+  for (size_t idx = 0; idx < statements.size(); idx++)
   {
-    const county_record& c = counties[idx];
-    if (c.geojson.empty() || c.geojson == "null") continue;
+    std::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query(statements[idx]);
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      conn->Rollback();
+      return -1;
+    }
+  }
+  conn->Commit();
 
-    if (!first) file << ",\n";
-    first = false;
+  std::chrono::steady_clock::time_point inserted = std::chrono::steady_clock::now();
 
-    std::string name_escaped = c.name;
-    size_t pos = 0;
-    while ((pos = name_escaped.find('"', pos)) != std::string::npos)
+  if (geometry)
+  {
+    // not loaded from a TopoJSON file; the next load_topojson reloads
+    set_meta("topojson_hash", "");
+    build_states();
+    if ((levels ? build_geojson() : build_levels()) < 0)
     {
-      name_escaped.replace(pos, 1, "\\\"");
-      pos += 2;
+      return -1;
     }
-
-    file << "{\"type\":\"Feature\","
-      << "\"id\":\"" << c.fips << "\","
-      << "\"properties\":{"
-      << "\"fips\":\"" << c.fips << "\","
-      << "\"name\":\"" << name_escaped << "\","
-      << "\"state\":\"" << c.state_name << "\","
-      << "\"gop\":" << c.votes_gop << ","
-      << "\"dem\":" << c.votes_dem << ","
-      << "\"total\":" << c.votes_total << ","
-      << "\"per_gop\":" << std::fixed << std::setprecision(6) << c.per_gop << ","
-      << "\"per_dem\":" << c.per_dem << ","
-      << "\"margin\":" << c.margin
-      << "},"
-      << "\"geometry\":" << c.geojson
-      << "}";
+    imported = get_years();
+  }
+  for (size_t idx = 0; idx < imported.size(); idx++)
+  {
+    if (build_aggregates(imported[idx]) < 0)
+    {
+      return -1;
+    }
+  }
+  if (build_swing(imported) < 0)
+  {
+    return -1;
   }
 
-  file << "\n]}\n";
-  file.close();
+  int64_t count = 0;
+  std::unique_ptr<duckdb::MaterializedQueryResult> count_result = conn->Query(
+    "SELECT COUNT(*) FROM results WHERE year IN (" + imported_list + ");");
+  chunk = count_result->HasError() ? nullptr : count_result->Fetch();
+  if (chunk && chunk->size() > 0)
+  {
+    count = chunk->GetValue(0, 0).GetValue<int64_t>();
+  }
 
-  std::cout << "Exported " << counties.size() << " counties to " << output_path << std::endl;
-  return static_cast<int>(counties.size());
+  std::cout << "Imported " << count << " results for years " << imported_list
+    << (geometry ? " and county geometry" : "") << " from " << directory << ": read "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(inserted - start).count() << " ms, rebuild "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - inserted).count()
+    << " ms" << std::endl;
+  return static_cast<int>(count);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -543,3 +2545,274 @@ void database_t::print_counties_info()
   }
   std::cout << std::endl;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bench_queries
+// per-call latency of the read queries: an ad hoc query, parsed, bound and planned on every call,
+// against the cached prepared statement; both fetch the complete result
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static size_t drain(duckdb::QueryResult& result)
+{
+  size_t rows = 0;
+  if (result.HasError())
+  {
+    std::cerr << result.GetError() << std::endl;
+    return 0;
+  }
+  duckdb::unique_ptr<duckdb::DataChunk> chunk;
+  while ((chunk = result.Fetch()) != nullptr && chunk->size() > 0)
+  {
+    rows += chunk->size();
+  }
+  return rows;
+}
+
+void database_t::bench_queries(int year, int iterations)
+{
+  struct bench_t
+  {
+    const char* name;
+    const char* sql;
+    std::unique_ptr<duckdb::PreparedStatement>* statement;
+    bool level;
+  };
+  bench_t benches[] =
+  {
+    { "get_counties", sql_counties, nullptr, false },
+    { "get_counties geometry", sql_county_geometry, nullptr, true },
+    { "get_states", sql_states, nullptr, false },
+    { "get_national", sql_national, nullptr, false }
+  };
+
+  lease_t lease(*this);
+  benches[0].statement = &lease->stmt_counties;
+  benches[1].statement = &lease->stmt_county_geometry;
+  benches[2].statement = &lease->stmt_states;
+  benches[3].statement = &lease->stmt_national;
+
+  if (iterations < 1) iterations = 1;
+  duckdb::Value year_value = duckdb::Value::INTEGER(year);
+  duckdb::Value level_value = duckdb::Value::INTEGER(0);
+
+  std::cout << "Query latency, " << year << ", " << iterations << " iterations" << std::endl;
+  for (size_t idx = 0; idx < sizeof(benches) / sizeof(benches[0]); idx++)
+  {
+    const bench_t& bench = benches[idx];
+    duckdb::PreparedStatement* statement = prepare(*lease->conn, *bench.statement, bench.sql);
+    if (!statement)
+    {
+      continue;
+    }
+
+    size_t rows = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++)
+    {
+      std::unique_ptr<duckdb::QueryResult> result = bench.level ?
+        lease->conn->Query(bench.sql, year_value, level_value) : lease->conn->Query(bench.sql, year_value);
+      rows = drain(*result);
+    }
+    std::chrono::steady_clock::time_point adhoc = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++)
+    {
+      std::unique_ptr<duckdb::QueryResult> result = bench.level ?
+        statement->Execute(year_value, level_value) : statement->Execute(year_value);
+      rows = drain(*result);
+    }
+    std::chrono::steady_clock::time_point prepared = std::chrono::steady_clock::now();
+
+    double adhoc_us = std::chrono::duration<double, std::micro>(adhoc - start).count() / iterations;
+    double prepared_us = std::chrono::duration<double, std::micro>(prepared - adhoc).count() / iterations;
+    std::cout << "  " << bench.name << ": " << rows << " rows, ad hoc " << static_cast<int64_t>(adhoc_us)
+      << " us, prepared " << static_cast<int64_t>(prepared_us) << " us, "
+      << static_cast<int64_t>(prepared_us > 0 ? 100.0 * (adhoc_us - prepared_us) / adhoc_us : 0) << "% less" << std::endl;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bench_extraction
+// record extraction only: the chunks are fetched once, then converted to county records by the
+// Value path and the columnar path, for the county set of the year and a synthetic 100k row set
+// with the same column types (every 7th state name NULL). Also reports the memory of the rows
+// as county records against the column table the cache holds
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void database_t::bench_extraction(int year, int iterations)
+{
+  static const char* sql_synthetic = R"(
+    SELECT 
+      lpad(CAST(i AS VARCHAR), 5, '0') as fips,
+      'County ' || i as name,
+      CASE WHEN i % 7 = 0 THEN NULL ELSE 'State ' || (i % 50) END as state_name,
+      lpad(CAST(i % 50 AS VARCHAR), 2, '0') as state_fips,
+      CAST(i * 3 AS BIGINT) as votes_gop,
+      CAST(i * 2 AS BIGINT) as votes_dem,
+      CAST(i * 6 AS BIGINT) as votes_total,
+      CAST(0.5 AS DOUBLE) as per_gop,
+      CAST(1.0 / 3 AS DOUBLE) as per_dem,
+      CAST((i % 200 - 100) / 100.0 AS DOUBLE) as margin,
+      '{"type":"Polygon","coordinates":[[[' || i || ',0],[1,1],[0,1],[' || i || ',0]]]}' as geojson
+    FROM range(100000) t(i)
+  )";
+
+  lease_t lease(*this);
+  if (iterations < 1) iterations = 1;
+  std::cout << "Record extraction, " << iterations << " iterations" << std::endl;
+
+  for (int set = 0; set < 2; set++)
+  {
+    std::unique_ptr<duckdb::QueryResult> result;
+    if (set == 0)
+    {
+      duckdb::PreparedStatement* statement = prepare(*lease->conn, lease->stmt_county_geometry, sql_county_geometry);
+      if (!statement)
+      {
+        continue;
+      }
+      result = statement->Execute(duckdb::Value::INTEGER(year), duckdb::Value::INTEGER(0));
+    }
+    else
+    {
+      result = lease->conn->Query(sql_synthetic);
+    }
+    if (result->HasError())
+    {
+      std::cerr << result->GetError() << std::endl;
+      continue;
+    }
+    if (!has_types(*result, county_types))
+    {
+      std::cerr << "Unexpected column types, columnar extraction not available" << std::endl;
+      continue;
+    }
+
+    std::vector<duckdb::unique_ptr<duckdb::DataChunk>> chunks;
+    duckdb::unique_ptr<duckdb::DataChunk> chunk;
+    while ((chunk = result->Fetch()) != nullptr && chunk->size() > 0)
+    {
+      chunk->Flatten();
+      chunks.push_back(std::move(chunk));
+    }
+
+    size_t rows = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++)
+    {
+      std::vector<county_record> records;
+      for (size_t idx = 0; idx < chunks.size(); idx++)
+      {
+        append_counties_values(*chunks[idx], records);
+      }
+      rows = records.size();
+    }
+    std::chrono::steady_clock::time_point values = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++)
+    {
+      std::vector<county_record> records;
+      for (size_t idx = 0; idx < chunks.size(); idx++)
+      {
+        append_counties_columnar(*chunks[idx], records);
+      }
+      rows = records.size();
+    }
+    std::chrono::steady_clock::time_point columnar = std::chrono::steady_clock::now();
+
+    double values_us = std::chrono::duration<double, std::micro>(values - start).count() / iterations;
+    double columnar_us = std::chrono::duration<double, std::micro>(columnar - values).count() / iterations;
+    std::cout << "  " << (set == 0 ? "counties " + std::to_string(year) : std::string("synthetic")) << ": " << rows
+      << " rows, Value " << static_cast<int64_t>(values_us) << " us, columnar " << static_cast<int64_t>(columnar_us)
+      << " us, " << static_cast<int64_t>(columnar_us > 0 ? values_us / columnar_us : 0) << "x faster" << std::endl;
+
+    std::vector<county_record> records;
+    for (size_t idx = 0; idx < chunks.size(); idx++)
+    {
+      append_counties_columnar(*chunks[idx], records);
+    }
+    county_table_t table;
+    size_t records_bytes = 0;
+    for (size_t idx = 0; idx < records.size(); idx++)
+    {
+      const county_record& c = records[idx];
+      records_bytes += sizeof(county_record) + c.fips.capacity() + c.name.capacity() + c.state_name.capacity() +
+        c.state_fips.capacity() + c.geojson.capacity();
+      table.append(c);
+    }
+    std::cout << "    " << records_bytes << " bytes as records, " << table.bytes() << " bytes as table" << std::endl;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bench_concurrency
+// simultaneous session startups (the county, state and national queries of a year) on 1, 2, 4 ...
+// threads: through one shared connection behind a mutex, as before the pool, and through pooled
+// connections. Reports startups per second and the scaling over one thread
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void database_t::bench_concurrency(int year, int iterations)
+{
+  if (iterations < 1) iterations = 1;
+  std::cout << "Session startups, " << year << ", " << iterations << " per thread, pool of "
+    << max_connections << " connections" << std::endl;
+
+  std::mutex shared_mutex;
+  connection_t shared;
+  shared.conn = std::make_unique<duckdb::Connection>(*db);
+
+  std::vector<size_t> counts;
+  for (size_t threads = 1; threads < max_connections; threads *= 2)
+  {
+    counts.push_back(threads);
+  }
+  counts.push_back(max_connections);
+
+  double base[2] = { 0, 0 };
+  for (size_t count = 0; count < counts.size(); count++)
+  {
+    size_t threads = counts[count];
+    double rates[2] = { 0, 0 };
+    for (int pooled = 0; pooled < 2; pooled++)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      std::vector<std::thread> workers;
+      for (size_t idx = 0; idx < threads; idx++)
+      {
+        workers.push_back(std::thread([&, pooled]()
+        {
+          for (int it = 0; it < iterations; it++)
+          {
+            if (pooled)
+            {
+              lease_t lease(*this);
+              read_counties(*lease, year, -1);
+              read_states(*lease, year);
+              read_national(*lease, year);
+            }
+            else
+            {
+              std::lock_guard<std::mutex> lock(shared_mutex);
+              read_counties(shared, year, -1);
+              read_states(shared, year);
+              read_national(shared, year);
+            }
+          }
+        }));
+      }
+      for (size_t idx = 0; idx < workers.size(); idx++)
+      {
+        workers[idx].join();
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      rates[pooled] = (seconds > 0) ? threads * iterations / seconds : 0;
+      if (threads == 1)
+      {
+        base[pooled] = rates[pooled];
+      }
+    }
+
+    std::cout << "  " << threads << " threads: shared " << static_cast<int64_t>(rates[0]) << "/s ("
+      << static_cast<int64_t>(base[0] > 0 ? 100 * rates[0] / base[0] : 0) << "%), pooled "
+      << static_cast<int64_t>(rates[1]) << "/s (" << static_cast<int64_t>(base[1] > 0 ? 100 * rates[1] / base[1] : 0)
+      << "%)" << std::endl;
+  }
+}
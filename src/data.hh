@@ -4,7 +4,12 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 #include "duckdb.hpp"
+#include "geometry.hh"
+#include "county_table.hh"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // county_record 
@@ -36,11 +41,111 @@ struct state_record
   double per_gop = 0.0;
   double per_dem = 0.0;
   std::string winner;
-  std::string geojson;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// national_record
+// per-year national sums of all county results, from national_results
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct national_record
+{
+  int64_t votes_gop = 0;
+  int64_t votes_dem = 0;
+  int64_t votes_total = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// swing_record
+// change of a county from base_year to year, from county_swing. Shares and margin as fractions
+// of the total (0.05 is 5 points), positive margin_shift is toward gop; turnout relative to the
+// base year's total
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct swing_record
+{
+  std::string fips;
+  double margin_shift = 0.0;
+  double per_gop_shift = 0.0;
+  double per_dem_shift = 0.0;
+  double turnout_change = 0.0;  // votes_total / base votes_total - 1, 0 when the base had none
+  int64_t votes_total_change = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// result_update
+// incremental county result from the live ingest; replaces the county's counts for the year
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct result_update
+{
+  int year = 0;
+  std::string fips;
+  int64_t votes_gop = 0;
+  int64_t votes_dem = 0;
+  int64_t votes_total = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// election_file
+// county results CSV of one year, as listed in a loader manifest
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct election_file
+{
+  std::string path;
+  int year = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tile_record
+// pre-generated Mapbox Vector Tile
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct tile_record
+{
+  int z = 0;
+  int x = 0;
+  int y = 0;
+  std::string data;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// startup_timing
+// milliseconds spent in each phase of opening a database_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct startup_timing
+{
+  double open = 0.0;  // DuckDB instance and primary connection
+  double extension = 0.0;  // spatial, loaded in-process
+  double schema = 0.0;  // tables, state names and migrations
+  double first_query = 0.0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// connection_t
+// pooled read connection; prepared statements belong to a connection, so each has its own,
+// executed with the year (and level) bound
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct connection_t
+{
+  std::unique_ptr<duckdb::Connection> conn;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_counties;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_county_geometry;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_states;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_national;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_shapes;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // database_t
+// loading and writes use the primary connection, one thread at a time (the loader, the live
+// feed under the payload cache update lock). Reads check a connection out of a pool over the same
+// DuckDB instance, so concurrent sessions query in parallel; connections are opened on demand
+// up to max_connections, then readers wait for one to be returned. Opened read-only, nothing is
+// created or migrated and every write method fails, so several processes can share the file
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 class database_t
@@ -49,19 +154,77 @@ private:
   std::unique_ptr<duckdb::DuckDB> db;
   std::unique_ptr<duckdb::Connection> conn;
   std::string db_path;
+  bool read_only;
+  startup_timing timing;
+
+  std::unique_ptr<duckdb::PreparedStatement> stmt_delete_year;
+  std::unique_ptr<duckdb::PreparedStatement> stmt_count_year;
+
+  size_t max_connections;
+  size_t open_connections;
+  std::vector<std::unique_ptr<connection_t>> idle;
+  std::mutex pool_mutex;
+  std::condition_variable pool_returned;
+
+  void create_schema();
+  void check_schema();
+  bool writable(const char* operation);
+  std::string get_meta(const std::string& key);
+  void set_meta(const std::string& key, const std::string& value);
+  std::unique_ptr<connection_t> checkout();
+  void checkin(std::unique_ptr<connection_t> connection);
+
+  class lease_t
+  {
+  public:
+    explicit lease_t(database_t& database) : database(database), connection(database.checkout()) {}
+    ~lease_t() { database.checkin(std::move(connection)); }
+    connection_t* operator->() const { return connection.get(); }
+    connection_t& operator*() const { return *connection; }
+
+  private:
+    database_t& database;
+    std::unique_ptr<connection_t> connection;
+  };
 
 public:
-  database_t(const std::string& path);
+  typedef std::function<bool(const std::vector<county_record>&)> county_callback_t;
+  typedef std::function<bool(duckdb::QueryResult&, duckdb::DataChunk&)> chunk_callback_t;
+
+  database_t(const std::string& path, size_t max_connections = 0, bool read_only = false);
 
   int load_topojson(const std::string& json_path);
   int load_election_csv(const std::string& csv_path, int year);
+  int load_election_files(const std::vector<election_file>& files, int threads = 0);
+  bool is_loaded(const std::string& json_path);
+  void set_loaded(const std::string& json_path);
+  int update_results(const std::vector<result_update>& updates);
   std::vector<int> get_years();
-  std::vector<county_record> get_counties(int year);
+  county_table_t get_counties(int year, int level = -1);
+  bool stream_counties(int year, int level, const county_callback_t& callback);
+  bool stream_query(const std::string& sql, std::vector<duckdb::Value> values, const chunk_callback_t& callback);
   std::vector<state_record> get_states(int year);
-  int64_t get_total_votes(int year);
-  int export_geojson(int year, const std::string& output_path);
+  national_record get_national(int year);
+  std::vector<swing_record> get_swing(int year, int base_year);
+  std::vector<shape_t> get_shapes(int level = 0);
+  std::vector<shape_t> get_state_shapes();
+  int build_levels();
+  int build_geojson();
+  int build_states();
+  int build_aggregates(int year);
+  int build_swing(int year);
+  int build_swing(const std::vector<int>& years);
+  int save_tiles(const std::vector<tile_record>& tiles);
+  std::vector<tile_record> get_tiles();
+  int export_geojson(int year, const std::string& output_path, int decimals = 6);
+  int export_parquet(const std::string& directory);
+  int import_parquet(const std::string& directory, const std::vector<int>& years = std::vector<int>());
   void print_summary(int year);
   void print_counties_info();
+  void print_startup_timing();
+  void bench_queries(int year, int iterations);
+  void bench_extraction(int year, int iterations);
+  void bench_concurrency(int year, int iterations);
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include <Wt/WApplication.h>
+#include <Wt/WServer.h>
 #include <Wt/WContainerWidget.h>
 #include <Wt/WCompositeWidget.h>
 #include <Wt/WHBoxLayout.h>
@@ -11,14 +12,44 @@
 #include <sstream>
 #include <memory>
 #include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <mutex>
 #include "data.hh"
+#include "payload.hh"
+#include "snapshot.hh"
 #include "map.hh"
+#include "resource.hh"
+#include "tiles.hh"
+#include "raster.hh"
+#include "live.hh"
+#include "topology.hh"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // globals
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 std::unique_ptr<database_t> db;
+std::unique_ptr<payload_cache_t> cache;
+std::unique_ptr<tile_source_t> tiles;
+std::unique_ptr<raster_source_t> raster;
+std::unique_ptr<live_feed_t> live;
+std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+std::once_flag first_session;
+bool read_only = false;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// raster_url
+// PNG tile template for a year, versioned by geometry and attributes
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string raster_url(int year)
+{
+  return "/raster/" + std::to_string(year) + "/{z}/{x}/{y}.png?v=" + raster->version(year);
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // format_number
@@ -44,18 +75,30 @@ class ApplicationElections : public Wt::WApplication
 {
 public:
   ApplicationElections(const Wt::WEnvironment& env);
+  ~ApplicationElections();
+
+  void on_live(const std::shared_ptr<const live_delta_t>& delta);
 
 private:
   int current_year;
-  std::vector<county_record> counties;
-  std::vector<state_record> states;
+  int base_year;  // compared year of the swing view, 0 when the current year has no earlier one
+  std::shared_ptr<const year_payload_t> payload;
 
   Wt::WMapLibre* map;
   Wt::WComboBox* year_combo;
+  Wt::WComboBox* view_combo;
+  Wt::WText* base_label;
+  Wt::WComboBox* base_combo;
+  Wt::WText* legend_text;
   Wt::WText* stats_text;
   Wt::WTable* results_table;
 
   void on_year_changed();
+  void on_view_changed();
+  void on_base_changed();
+  void update_base_years();
+  void update_legend();
+  void update_sources();
   void update_stats();
   void update_table();
 };
@@ -65,16 +108,17 @@ private:
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 ApplicationElections::ApplicationElections(const Wt::WEnvironment& env)
-  : Wt::WApplication(env), current_year(2024)
+  : Wt::WApplication(env), current_year(2024), base_year(0), view_combo(nullptr), base_label(nullptr), base_combo(nullptr)
 {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   setTitle("US Elections");
 
-  if (db)
+  std::vector<int> years;
+  if (cache)
   {
-    std::vector<int> years = db->get_years();
+    years = cache->get_years();
     if (!years.empty()) current_year = years[0];
-    counties = db->get_counties(current_year);
-    states = db->get_states(current_year);
+    payload = cache->get(current_year);
   }
 
   std::unique_ptr<Wt::WHBoxLayout> layout = std::make_unique<Wt::WHBoxLayout>();
@@ -97,9 +141,8 @@ ApplicationElections::ApplicationElections(const Wt::WEnvironment& env)
   styleSheet().addRule("#" + combo_id,
     "width:100%;padding:8px;margin:5px 0 15px 0;background:#16213e;color:#fff;border:1px solid #0f3460;border-radius:4px;");
 
-  if (db)
+  if (!years.empty())
   {
-    std::vector<int> years = db->get_years();
     for (size_t idx = 0; idx < years.size(); idx++)
     {
       year_combo->addItem(std::to_string(years[idx]));
@@ -111,20 +154,45 @@ ApplicationElections::ApplicationElections(const Wt::WEnvironment& env)
   }
   year_combo->changed().connect(this, &ApplicationElections::on_year_changed);
 
+  // the state and swing views need feature state on a GeoJSON source; vector and raster tiles
+  // show the county results only
+  const std::string* source = env.getParameter("source");
+  bool tiled = source && ((*source == "mvt" && tiles) || (*source == "raster" && raster));
+  if (!tiled)
+  {
+    layout_sidebar->addWidget(std::make_unique<Wt::WText>("<b>View</b>"));
+    view_combo = layout_sidebar->addWidget(std::make_unique<Wt::WComboBox>());
+    styleSheet().addRule("#" + view_combo->id(),
+      "width:100%;padding:8px;margin:5px 0 15px 0;background:#16213e;color:#fff;border:1px solid #0f3460;border-radius:4px;");
+    view_combo->addItem("County");
+    view_combo->addItem("State");
+    view_combo->addItem("Swing");
+    const std::string* view = env.getParameter("view");
+    if (view && *view == "state")
+    {
+      view_combo->setCurrentIndex(1);
+    }
+    else if (view && *view == "swing")
+    {
+      view_combo->setCurrentIndex(2);
+    }
+    view_combo->changed().connect(this, &ApplicationElections::on_view_changed);
+
+    // swing view: the year compared with, the previous election by default
+    base_label = layout_sidebar->addWidget(std::make_unique<Wt::WText>("<b>Swing From</b>"));
+    base_combo = layout_sidebar->addWidget(std::make_unique<Wt::WComboBox>());
+    styleSheet().addRule("#" + base_combo->id(),
+      "width:100%;padding:8px;margin:5px 0 15px 0;background:#16213e;color:#fff;border:1px solid #0f3460;border-radius:4px;");
+    base_combo->changed().connect(this, &ApplicationElections::on_base_changed);
+    update_base_years();
+  }
+
   layout_sidebar->addWidget(std::make_unique<Wt::WText>("<b>Legend</b>"));
-  layout_sidebar->addWidget(std::make_unique<Wt::WText>(
-    "<div style='font-size:11px;margin:10px 0;'>"
-    "<div style='margin:3px 0;'><span style='background:#B82D35;padding:2px 12px;'></span> Strong GOP</div>"
-    "<div style='margin:3px 0;'><span style='background:#E48268;padding:2px 12px;'></span> Lean GOP</div>"
-    "<div style='margin:3px 0;'><span style='background:#FACCB4;padding:2px 12px;'></span> Slight GOP</div>"
-    "<div style='margin:3px 0;'><span style='background:#BFDCEB;padding:2px 12px;'></span> Slight DEM</div>"
-    "<div style='margin:3px 0;'><span style='background:#6BACD0;padding:2px 12px;'></span> Lean DEM</div>"
-    "<div style='margin:3px 0;'><span style='background:#2A71AE;padding:2px 12px;'></span> Strong DEM</div>"
-    "</div>"));
+  legend_text = layout_sidebar->addWidget(std::make_unique<Wt::WText>());
+  update_legend();
 
   layout_sidebar->addWidget(std::make_unique<Wt::WText>("<b>National Results</b>"));
   stats_text = layout_sidebar->addWidget(std::make_unique<Wt::WText>());
-  update_stats();
 
   layout_sidebar->addWidget(std::make_unique<Wt::WText>("<b>State Results</b>"));
   results_table = layout_sidebar->addWidget(std::make_unique<Wt::WTable>());
@@ -140,11 +208,85 @@ ApplicationElections::ApplicationElections(const Wt::WEnvironment& env)
   std::unique_ptr<Wt::WContainerWidget> container_map = std::make_unique<Wt::WContainerWidget>();
   map = container_map->addWidget(std::make_unique<Wt::WMapLibre>());
   map->resize(Wt::WLength::Auto, Wt::WLength::Auto);
-  map->counties = &counties;
+  map->payload = payload;
   map->current_year = current_year;
+  // ?source=mvt selects vector tiles, ?source=topojson the shared-arc document, ?source=binary
+  // typed coordinate arrays and ?source=raster server rendered PNG tiles, instead of GeoJSON;
+  // ?view=state starts in the state view, ?view=swing in the swing view
+  if (source && *source == "mvt" && tiles)
+  {
+    map->set_source_mode("mvt");
+  }
+  else if (source && *source == "raster" && raster)
+  {
+    map->set_source_mode("raster");
+  }
+  else if (source && (*source == "topojson" || *source == "binary"))
+  {
+    map->set_source_mode(*source);
+  }
+  if (view_combo && view_combo->currentIndex() == 1)
+  {
+    map->set_view_mode("state");
+  }
+  else if (view_combo && view_combo->currentIndex() == 2)
+  {
+    map->set_view_mode("swing");
+  }
+  update_sources();
+  // the swing view adds the national change, so stats follow the view mode
+  update_stats();
 
   layout->addWidget(std::move(container_map), 1);
   root()->setLayout(std::move(layout));
+
+  // server push for live results
+  if (live)
+  {
+    enableUpdates(true);
+    live->subscribe(sessionId());
+  }
+
+  std::cout << "Session " << sessionId() << " setup: "
+    << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+    << " us" << std::endl;
+}
+
+ApplicationElections::~ApplicationElections()
+{
+  if (live)
+  {
+    live->unsubscribe(sessionId());
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// on_live
+// runs in the session, posted by the live feed; the delta was serialized once for all sessions
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::on_live(const std::shared_ptr<const live_delta_t>& delta)
+{
+  if (delta->year != current_year)
+  {
+    return;
+  }
+
+  payload = delta->payload;
+  map->payload = payload;
+  update_sources();
+  if (map->source_mode == "raster" || map->view_mode == "swing")
+  {
+    // the tick serialized the year pair's swing again; sessions fetch the shared blob
+    map->refresh_data();
+  }
+  else
+  {
+    doJavaScript(map->view_mode == "state" ? delta->state_js : delta->county_js);
+  }
+  update_stats();
+  update_table();
+  triggerUpdate();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -153,43 +295,215 @@ ApplicationElections::ApplicationElections(const Wt::WEnvironment& env)
 
 void ApplicationElections::on_year_changed()
 {
-  if (!db) return;
+  if (!cache) return;
 
   current_year = std::stoi(year_combo->currentText().toUTF8());
-  counties = db->get_counties(current_year);
-  states = db->get_states(current_year);
+  payload = cache->get(current_year);
+  update_base_years();
 
   map->current_year = current_year;
-  map->counties = &counties;
+  map->payload = payload;
+  update_sources();
   map->refresh_data();
 
   update_stats();
   update_table();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// on_view_changed
+// county, state and swing views share the map source; the geometry document is swapped when
+// switching to or from the state view, the rows on every switch
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::on_view_changed()
+{
+  static const char* modes[] = { "county", "state", "swing" };
+  bool state_view = (map->view_mode == "state");
+  map->set_view_mode(modes[std::max(0, std::min(view_combo->currentIndex(), 2))]);
+  update_base_years();
+  update_legend();
+  update_sources();
+  if (state_view != (map->view_mode == "state"))
+  {
+    map->refresh_geometry();
+  }
+  map->refresh_data();
+  update_stats();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// on_base_changed
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::on_base_changed()
+{
+  base_year = std::stoi(base_combo->currentText().toUTF8());
+  update_sources();
+  map->refresh_data();
+  update_stats();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// update_base_years
+// the years before the current one, newest first; the selected year is kept when still earlier,
+// otherwise the previous election is selected. Shown in the swing view only
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::update_base_years()
+{
+  if (!base_combo)
+  {
+    return;
+  }
+
+  bool swing_view = (view_combo->currentIndex() == 2);
+  base_label->setHidden(!swing_view);
+  base_combo->setHidden(!swing_view);
+
+  std::vector<int> years;
+  if (cache)
+  {
+    years = cache->get_years();
+  }
+  base_combo->clear();
+  int selected = 0;
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    if (years[idx] >= current_year)
+    {
+      continue;
+    }
+    if (years[idx] == base_year || selected == 0)
+    {
+      selected = years[idx];
+    }
+    base_combo->addItem(std::to_string(years[idx]));
+  }
+  base_year = selected;
+  if (base_year != 0)
+  {
+    base_combo->setCurrentIndex(base_combo->findText(std::to_string(base_year)));
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// update_legend
+// margin buckets, or the swing buckets of swing_color_expression
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::update_legend()
+{
+  if (view_combo && view_combo->currentIndex() == 2)
+  {
+    legend_text->setText(
+      "<div style='font-size:11px;margin:10px 0;'>"
+      "<div style='margin:3px 0;'><span style='background:#B82D35;padding:2px 12px;'></span> GOP +10 pts or more</div>"
+      "<div style='margin:3px 0;'><span style='background:#E48268;padding:2px 12px;'></span> GOP +5 to 10 pts</div>"
+      "<div style='margin:3px 0;'><span style='background:#FACCB4;padding:2px 12px;'></span> GOP up to +5 pts</div>"
+      "<div style='margin:3px 0;'><span style='background:#BFDCEB;padding:2px 12px;'></span> DEM up to +5 pts</div>"
+      "<div style='margin:3px 0;'><span style='background:#6BACD0;padding:2px 12px;'></span> DEM +5 to 10 pts</div>"
+      "<div style='margin:3px 0;'><span style='background:#2A71AE;padding:2px 12px;'></span> DEM +10 pts or more</div>"
+      "</div>");
+    return;
+  }
+
+  legend_text->setText(
+    "<div style='font-size:11px;margin:10px 0;'>"
+    "<div style='margin:3px 0;'><span style='background:#B82D35;padding:2px 12px;'></span> Strong GOP</div>"
+    "<div style='margin:3px 0;'><span style='background:#E48268;padding:2px 12px;'></span> Lean GOP</div>"
+    "<div style='margin:3px 0;'><span style='background:#FACCB4;padding:2px 12px;'></span> Slight GOP</div>"
+    "<div style='margin:3px 0;'><span style='background:#BFDCEB;padding:2px 12px;'></span> Slight DEM</div>"
+    "<div style='margin:3px 0;'><span style='background:#6BACD0;padding:2px 12px;'></span> Lean DEM</div>"
+    "<div style='margin:3px 0;'><span style='background:#2A71AE;padding:2px 12px;'></span> Strong DEM</div>"
+    "</div>");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// update_sources
+// resource URLs for the current year, view and source mode, versioned by content hash
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ApplicationElections::update_sources()
+{
+  if (!cache)
+  {
+    return;
+  }
+
+  bool state_view = (map->view_mode == "state");
+  map->geometry_urls.clear();
+  if (state_view)
+  {
+    std::shared_ptr<const blob_t> states = cache->get_state_geometry();
+    map->geometry_urls.push_back("/geometry/states.geojson?v=" + (states ? states->hash : std::string()));
+  }
+  else
+  {
+    for (int idx = 0; idx < geometry_level_count; idx++)
+    {
+      int level = geometry_levels[idx].level;
+      std::shared_ptr<const blob_t> blob;
+      std::string path;
+      if (map->source_mode == "topojson")
+      {
+        blob = cache->get_topojson(level);
+        path = "/geometry/counties.topojson";
+      }
+      else if (map->source_mode == "binary")
+      {
+        blob = cache->get_binary(level);
+        path = "/geometry/counties.bin";
+      }
+      else
+      {
+        blob = cache->get_geometry(level);
+        path = "/geometry/counties.geojson";
+      }
+      map->geometry_urls.push_back(path + "?level=" + std::to_string(level) + "&v=" + (blob ? blob->hash : std::string()));
+    }
+  }
+  std::shared_ptr<const blob_t> geometry = cache->get_geometry();
+  map->tiles_url = "/tiles/{z}/{x}/{y}.mvt?v=" + (geometry ? geometry->hash : std::string());
+
+  if (map->view_mode == "swing")
+  {
+    // no earlier year: empty rows sent inline
+    map->swing = base_year ? cache->get_swing(current_year, base_year) : nullptr;
+    map->attributes_url = map->swing ? "/attributes/swing/" + std::to_string(current_year) + "/" +
+      std::to_string(base_year) + ".json?v=" + map->swing->hash : "";
+  }
+  else if (payload)
+  {
+    const blob_t& rows = state_view ? payload->state_attributes : payload->attributes;
+    map->attributes_url = std::string(state_view ? "/attributes/states/" : "/attributes/") +
+      std::to_string(current_year) + ".json?v=" + rows.hash;
+  }
+  if (raster)
+  {
+    map->raster_url = raster_url(current_year);
+  }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // update_stats
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void ApplicationElections::update_stats()
 {
-  if (!db)
+  if (!payload)
   {
     return;
   }
 
-  int64_t total = db->get_total_votes(current_year);
+  int64_t total = payload->national.votes_total;
   if (total == 0)
   {
     return;
   }
 
-  int64_t gop = 0, dem = 0;
-  for (size_t idx = 0; idx < states.size(); idx++)
-  {
-    gop += states[idx].votes_gop;
-    dem += states[idx].votes_dem;
-  }
+  int64_t gop = payload->national.votes_gop;
+  int64_t dem = payload->national.votes_dem;
 
   std::stringstream ss;
   ss << std::fixed << std::setprecision(1);
@@ -197,6 +511,18 @@ void ApplicationElections::update_stats()
   ss << "<div style='color:#B82D35;'>GOP: " << format_number(gop) << " (" << (100.0 * gop / total) << "%)</div>";
   ss << "<div style='color:#6BACD0;'>DEM: " << format_number(dem) << " (" << (100.0 * dem / total) << "%)</div>";
   ss << "<div style='color:#888;margin-top:5px;'>Total: " << format_number(total) << "</div>";
+
+  // national swing from the aggregates of both years, already in the cached payloads
+  std::shared_ptr<const year_payload_t> base = (map->view_mode == "swing" && base_year) ? cache->get(base_year) : nullptr;
+  if (base && base->national.votes_total > 0)
+  {
+    const national_record& b = base->national;
+    double shift = static_cast<double>(gop - dem) / total - static_cast<double>(b.votes_gop - b.votes_dem) / b.votes_total;
+    ss << "<div style='color:" << (shift > 0 ? "#B82D35" : "#6BACD0") << ";margin-top:5px;'>Swing from " << base_year
+      << ": " << (shift > 0 ? "GOP" : "DEM") << " +" << std::abs(shift) * 100 << " pts</div>";
+    ss << "<div style='color:#888;'>Turnout: " << std::showpos << (100.0 * total / b.votes_total - 100) << std::noshowpos
+      << "%</div>";
+  }
   ss << "</div>";
 
   stats_text->setText(ss.str());
@@ -210,6 +536,13 @@ void ApplicationElections::update_table()
 {
   results_table->clear();
 
+  if (!payload)
+  {
+    return;
+  }
+
+  const std::vector<state_record>& states = payload->states;
+
   results_table->elementAt(0, 0)->addWidget(std::make_unique<Wt::WText>("State"));
   results_table->elementAt(0, 1)->addWidget(std::make_unique<Wt::WText>("Winner"));
   results_table->elementAt(0, 2)->addWidget(std::make_unique<Wt::WText>("Margin"));
@@ -234,7 +567,14 @@ void ApplicationElections::update_table()
 
 std::unique_ptr<Wt::WApplication> create_application(const Wt::WEnvironment& env)
 {
-  return std::make_unique<ApplicationElections>(env);
+  std::unique_ptr<Wt::WApplication> app = std::make_unique<ApplicationElections>(env);
+  std::call_once(first_session, []()
+  {
+    std::cout << "First session served "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+      << " ms after start" << std::endl;
+  });
+  return app;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -243,15 +583,247 @@ std::unique_ptr<Wt::WApplication> create_application(const Wt::WEnvironment& env
 
 int main(int argc, char* argv[])
 {
+  // ELECTIONS_READ_ONLY opens elections.duckdb without DDL or writes, so several processes can
+  // serve it (or a snapshot) side by side; live ingest is then disabled
+  const char* read_only_env = std::getenv("ELECTIONS_READ_ONLY");
+  read_only = read_only_env && *read_only_env && std::string(read_only_env) != "0";
+
+  // live ingest is enabled by setting ELECTIONS_INGEST_TOKEN, except read-only or from a snapshot;
+  // without it there is no live feed, and sessions hold no server-push connection
+  const char* token = std::getenv("ELECTIONS_INGEST_TOKEN");
+  const char* snapshot_env = std::getenv("ELECTIONS_SNAPSHOT");
+  bool from_snapshot = snapshot_env && *snapshot_env;
+  bool ingest = token && *token && !read_only && !from_snapshot;
+
   try
   {
-    db = std::make_unique<database_t>("elections.duckdb");
-    db->print_counties_info();
+    // ELECTIONS_SNAPSHOT serves a file written by loader --snapshot: payloads, geometry and shapes
+    // are mapped, nothing is queried or serialized, and the database is not opened. Live ingest
+    // is disabled, as ingested results would not reach the snapshot served after a restart
+    std::shared_ptr<const snapshot_t> snapshot;
+    if (from_snapshot)
+    {
+      snapshot = snapshot_t::open(snapshot_env);
+      if (!snapshot)
+      {
+        throw std::runtime_error(std::string("Cannot open snapshot ") + snapshot_env);
+      }
+      cache = std::make_unique<payload_cache_t>(snapshot);
+    }
+    else
+    {
+      // ELECTIONS_PARQUET serves a directory written by loader --export-parquet from an in-memory
+      // database instead of elections.duckdb
+      const char* parquet = std::getenv("ELECTIONS_PARQUET");
+      if (parquet && *parquet)
+      {
+        db = std::make_unique<database_t>(":memory:");
+        if (db->import_parquet(parquet) < 0)
+        {
+          throw std::runtime_error(std::string("Cannot import Parquet from ") + parquet);
+        }
+      }
+      else
+      {
+        db = std::make_unique<database_t>("elections.duckdb", 0, read_only);
+      }
+      db->print_startup_timing();
+      db->print_counties_info();
+      cache = std::make_unique<payload_cache_t>(*db);
+      cache->build_all();
+    }
+    std::shared_ptr<const blob_t> geometry = cache->get_geometry();
+    if (!geometry)
+    {
+      throw std::runtime_error("No county geometry to serve; run the loader");
+    }
+    tiles = std::make_unique<tile_source_t>(snapshot ? read_snapshot_shapes(*snapshot, 0) : db->get_shapes(),
+      geometry->hash, 4096);
+    tiles->preload(snapshot ? read_snapshot_tiles(*snapshot) : db->get_tiles());
+
+    // raster tiles for low-end clients; low zooms are rendered up front for every year, except
+    // for a snapshot, which is served at once: its tiles render on demand or come from raster_cache
+    std::vector<std::vector<shape_t>> levels;
+    for (int idx = 0; idx < geometry_level_count; idx++)
+    {
+      int level = geometry_levels[idx].level;
+      levels.push_back(snapshot ? read_snapshot_shapes(*snapshot, level) : db->get_shapes(level));
+    }
+    raster = std::make_unique<raster_source_t>(*cache, levels, geometry->hash, "raster_cache", 4096);
+    if (!snapshot)
+    {
+      raster->prerender(cache->get_years(), 6, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    }
+
+    // live results: updates are applied and pushed to sessions once per second
+    if (ingest)
+    {
+      live = std::make_unique<live_feed_t>(*cache,
+        [](const live_delta_t& delta)
+        {
+          if (raster)
+          {
+            raster->invalidate(delta.year);
+          }
+        },
+        [](const std::string& session, const std::shared_ptr<const live_delta_t>& delta)
+        {
+          Wt::WServer::instance()->post(session, [delta]()
+          {
+            ApplicationElections* app = dynamic_cast<ApplicationElections*>(Wt::WApplication::instance());
+            if (app)
+            {
+              app->on_live(delta);
+            }
+          });
+        },
+        1000);
+    }
   }
   catch (const std::exception& e)
   {
     std::cerr << e.what() << std::endl;
   }
 
-  return Wt::WRun(argc, argv, &create_application);
+  try
+  {
+    Wt::WServer server(argc, argv, WTHTTP_CONFIGURATION);
+
+    if (cache)
+    {
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          const std::string* level = request.getParameter("level");
+          return cache->get_geometry(level ? std::atoi(level->c_str()) : 0);
+        }),
+        "/geometry/counties.geojson");
+
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          const std::string* level = request.getParameter("level");
+          return cache->get_topojson(level ? std::atoi(level->c_str()) : 0);
+        }),
+        "/geometry/counties.topojson");
+
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          const std::string* level = request.getParameter("level");
+          return cache->get_binary(level ? std::atoi(level->c_str()) : 0);
+        }),
+        "/geometry/counties.bin");
+
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request&) -> std::shared_ptr<const blob_t>
+        {
+          return cache->get_state_geometry();
+        }),
+        "/geometry/states.geojson");
+    }
+
+    if (cache)
+    {
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          // /attributes/<year>.json, /attributes/states/<year>.json,
+          // /attributes/swing/<year>/<base_year>.json
+          const std::string& path = request.pathInfo();
+          const std::string suffix = ".json";
+          const std::string states = "/states";
+          const std::string swing = "/swing";
+          if (path.size() <= suffix.size() + 1 || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0)
+          {
+            return nullptr;
+          }
+          if (path.compare(0, states.size() + 1, states + "/") == 0)
+          {
+            return cache->get_state_attributes(std::atoi(path.c_str() + states.size() + 1));
+          }
+          if (path.compare(0, swing.size() + 1, swing + "/") == 0)
+          {
+            size_t pos = path.find('/', swing.size() + 1);
+            if (pos == std::string::npos)
+            {
+              return nullptr;
+            }
+            return cache->get_swing(std::atoi(path.c_str() + swing.size() + 1), std::atoi(path.c_str() + pos + 1));
+          }
+          return cache->get_attributes(std::atoi(path.c_str() + 1));
+        }),
+        "/attributes");
+    }
+
+    if (tiles)
+    {
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          int z, x, y;
+          if (!parse_tile_path(request.pathInfo(), ".mvt", z, x, y))
+          {
+            return nullptr;
+          }
+          return tiles->get(z, x, y);
+        }),
+        "/tiles");
+    }
+
+    if (raster)
+    {
+      server.addResource(std::make_shared<payload_resource_t>(
+        [](const Wt::Http::Request& request) -> std::shared_ptr<const blob_t>
+        {
+          int year, z, x, y;
+          if (!parse_raster_path(request.pathInfo(), year, z, x, y))
+          {
+            return nullptr;
+          }
+          return raster->get(year, z, x, y);
+        }),
+        "/raster");
+    }
+
+    if (live)
+    {
+      server.addResource(std::make_shared<ingest_resource_t>(*live, *cache, token), "/ingest");
+    }
+    else if (from_snapshot)
+    {
+      std::cout << "Live ingest disabled, serving a snapshot" << std::endl;
+    }
+    else if (read_only)
+    {
+      std::cout << "Live ingest disabled, read-only" << std::endl;
+    }
+    else
+    {
+      std::cout << "Live ingest disabled, ELECTIONS_INGEST_TOKEN not set" << std::endl;
+    }
+
+    server.addEntryPoint(Wt::EntryPointType::Application, &create_application);
+
+    std::cout << "Startup: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+      << " ms" << std::endl;
+
+    if (server.start())
+    {
+      Wt::WServer::waitForShutdown();
+      if (live)
+      {
+        live->stop();
+      }
+      server.stop();
+    }
+  }
+  catch (const Wt::WServer::Exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
 }
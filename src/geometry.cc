@@ -0,0 +1,255 @@
+#include "geometry.hh"
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// wkb_reader_t
+// cursor over a WKB buffer; handles both byte orders and skips Z/M ordinates
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct wkb_reader_t
+{
+  const unsigned char* data;
+  size_t size;
+  size_t pos;
+  bool little;
+
+  bool read_byte(unsigned char& value)
+  {
+    if (pos + 1 > size) return false;
+    value = data[pos++];
+    return true;
+  }
+
+  bool read_uint32(uint32_t& value)
+  {
+    if (pos + 4 > size) return false;
+    unsigned char b[4];
+    memcpy(b, data + pos, 4);
+    pos += 4;
+    if (little)
+    {
+      value = b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+    }
+    else
+    {
+      value = b[3] | (b[2] << 8) | (b[1] << 16) | (static_cast<uint32_t>(b[0]) << 24);
+    }
+    return true;
+  }
+
+  bool read_double(double& value)
+  {
+    if (pos + 8 > size) return false;
+    unsigned char b[8];
+    memcpy(b, data + pos, 8);
+    pos += 8;
+    uint64_t bits = 0;
+    for (int idx = 0; idx < 8; idx++)
+    {
+      int shift = little ? idx : 7 - idx;
+      bits |= static_cast<uint64_t>(b[idx]) << (8 * shift);
+    }
+    memcpy(&value, &bits, 8);
+    return true;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_geometry
+// polygon, multipolygon and geometry collection; other types are skipped when nested
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool read_geometry(wkb_reader_t& reader, multipolygon_t& polygons)
+{
+  unsigned char order;
+  if (!reader.read_byte(order)) return false;
+  reader.little = (order == 1);
+
+  uint32_t type;
+  if (!reader.read_uint32(type)) return false;
+
+  // EWKB flags and ISO 1000/2000/3000 dimension offsets
+  bool has_z = (type & 0x80000000) != 0;
+  bool has_m = (type & 0x40000000) != 0;
+  if (type & 0x20000000)
+  {
+    uint32_t srid;
+    if (!reader.read_uint32(srid)) return false;
+  }
+  type &= 0x0fffffff;
+  if (type >= 3000) { has_z = true; has_m = true; type -= 3000; }
+  else if (type >= 2000) { has_m = true; type -= 2000; }
+  else if (type >= 1000) { has_z = true; type -= 1000; }
+  int extra = (has_z ? 1 : 0) + (has_m ? 1 : 0);
+
+  switch (type)
+  {
+  case 3:
+  {
+    uint32_t num_rings;
+    if (!reader.read_uint32(num_rings)) return false;
+    // every ring has at least its point count
+    if (reader.pos + static_cast<size_t>(num_rings) * 4 > reader.size) return false;
+    polygon_t polygon;
+    polygon.resize(num_rings);
+    for (uint32_t idx_ring = 0; idx_ring < num_rings; idx_ring++)
+    {
+      uint32_t num_points;
+      if (!reader.read_uint32(num_points)) return false;
+      if (reader.pos + static_cast<size_t>(num_points) * (16 + 8 * extra) > reader.size) return false;
+      ring_t& ring = polygon[idx_ring];
+      ring.resize(num_points);
+      for (uint32_t idx = 0; idx < num_points; idx++)
+      {
+        if (!reader.read_double(ring[idx].x)) return false;
+        if (!reader.read_double(ring[idx].y)) return false;
+        for (int idx_extra = 0; idx_extra < extra; idx_extra++)
+        {
+          double skip;
+          if (!reader.read_double(skip)) return false;
+        }
+      }
+    }
+    if (!polygon.empty())
+    {
+      polygons.push_back(std::move(polygon));
+    }
+    return true;
+  }
+  case 6:
+  case 7:
+  {
+    uint32_t num_geometries;
+    if (!reader.read_uint32(num_geometries)) return false;
+    for (uint32_t idx = 0; idx < num_geometries; idx++)
+    {
+      if (!read_geometry(reader, polygons)) return false;
+    }
+    return true;
+  }
+  default:
+    // points and lines carry no area; not expected in county data
+    return false;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_wkb
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool read_wkb(const char* data, size_t size, multipolygon_t& polygons)
+{
+  wkb_reader_t reader;
+  reader.data = reinterpret_cast<const unsigned char*>(data);
+  reader.size = size;
+  reader.pos = 0;
+  reader.little = true;
+  polygons.clear();
+  return read_geometry(reader, polygons);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bounding_box
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BoundingBox bounding_box(const polygon_t& polygon)
+{
+  double max = std::numeric_limits<double>::max();
+  BoundingBox bbox(max, max, -max, -max);
+  for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+  {
+    const ring_t& ring = polygon[idx_ring];
+    for (size_t idx = 0; idx < ring.size(); idx++)
+    {
+      if (ring[idx].x < bbox.min_x) bbox.min_x = ring[idx].x;
+      if (ring[idx].y < bbox.min_y) bbox.min_y = ring[idx].y;
+      if (ring[idx].x > bbox.max_x) bbox.max_x = ring[idx].x;
+      if (ring[idx].y > bbox.max_y) bbox.max_y = ring[idx].y;
+    }
+  }
+  return bbox;
+}
+
+BoundingBox bounding_box(const multipolygon_t& polygons)
+{
+  double max = std::numeric_limits<double>::max();
+  BoundingBox bbox(max, max, -max, -max);
+  for (size_t idx = 0; idx < polygons.size(); idx++)
+  {
+    BoundingBox b = bounding_box(polygons[idx]);
+    if (b.min_x < bbox.min_x) bbox.min_x = b.min_x;
+    if (b.min_y < bbox.min_y) bbox.min_y = b.min_y;
+    if (b.max_x > bbox.max_x) bbox.max_x = b.max_x;
+    if (b.max_y > bbox.max_y) bbox.max_y = b.max_y;
+  }
+  return bbox;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// count_points
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t count_points(const multipolygon_t& polygons)
+{
+  size_t count = 0;
+  for (size_t idx_polygon = 0; idx_polygon < polygons.size(); idx_polygon++)
+  {
+    for (size_t idx_ring = 0; idx_ring < polygons[idx_polygon].size(); idx_ring++)
+    {
+      count += polygons[idx_polygon][idx_ring].size();
+    }
+  }
+  return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_wkb
+// little endian multipolygon, the inverse of read_wkb
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_uint32(std::string& out, uint32_t value)
+{
+  for (int idx = 0; idx < 4; idx++)
+  {
+    out.push_back(static_cast<char>((value >> (8 * idx)) & 0xff));
+  }
+}
+
+static void write_double(std::string& out, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, 8);
+  for (int idx = 0; idx < 8; idx++)
+  {
+    out.push_back(static_cast<char>((bits >> (8 * idx)) & 0xff));
+  }
+}
+
+std::string write_wkb(const multipolygon_t& polygons)
+{
+  std::string out;
+  out.reserve(9 + count_points(polygons) * 16 + polygons.size() * 9);
+  out.push_back(1);
+  write_uint32(out, 6);
+  write_uint32(out, static_cast<uint32_t>(polygons.size()));
+  for (size_t idx_polygon = 0; idx_polygon < polygons.size(); idx_polygon++)
+  {
+    const polygon_t& polygon = polygons[idx_polygon];
+    out.push_back(1);
+    write_uint32(out, 3);
+    write_uint32(out, static_cast<uint32_t>(polygon.size()));
+    for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+    {
+      const ring_t& ring = polygon[idx_ring];
+      write_uint32(out, static_cast<uint32_t>(ring.size()));
+      for (size_t idx = 0; idx < ring.size(); idx++)
+      {
+        write_double(out, ring[idx].x);
+        write_double(out, ring[idx].y);
+      }
+    }
+  }
+  return out;
+}
@@ -0,0 +1,37 @@
+#ifndef ELECTIONS_GEOMETRY_HH
+#define ELECTIONS_GEOMETRY_HH
+
+#include <string>
+#include <vector>
+#include "spatial.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// polygon types
+// rings are closed (last point equals first); the first ring of a polygon is the exterior
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef std::vector<Point2D> ring_t;
+typedef std::vector<ring_t> polygon_t;
+typedef std::vector<polygon_t> multipolygon_t;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// shape_t
+// county geometry decoded from WKB, lon/lat degrees
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct shape_t
+{
+  std::string fips;
+  std::string name;
+  std::string state_name;
+  multipolygon_t polygons;
+  BoundingBox bbox;
+};
+
+bool read_wkb(const char* data, size_t size, multipolygon_t& polygons);
+BoundingBox bounding_box(const polygon_t& polygon);
+BoundingBox bounding_box(const multipolygon_t& polygons);
+size_t count_points(const multipolygon_t& polygons);
+std::string write_wkb(const multipolygon_t& polygons);
+
+#endif
@@ -0,0 +1,293 @@
+#include "json.hh"
+#include <charconv>
+#include <cmath>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// append_json_string
+// quoted and escaped in one pass; runs of plain characters are appended in one call
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void append_json_string(std::string& out, std::string_view str)
+{
+  static const char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  size_t run = 0;
+  for (size_t idx = 0; idx < str.size(); idx++)
+  {
+    unsigned char c = static_cast<unsigned char>(str[idx]);
+    if (c >= 0x20 && c != '"' && c != '\\')
+    {
+      continue;
+    }
+    out.append(str.data() + run, idx - run);
+    run = idx + 1;
+    switch (c)
+    {
+    case '"': out.append("\\\""); break;
+    case '\\': out.append("\\\\"); break;
+    case '\n': out.append("\\n"); break;
+    case '\r': out.append("\\r"); break;
+    case '\t': out.append("\\t"); break;
+    default:
+      out.append("\\u00");
+      out.push_back(hex[c >> 4]);
+      out.push_back(hex[c & 0xf]);
+      break;
+    }
+  }
+  out.append(str.data() + run, str.size() - run);
+  out.push_back('"');
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// json_writer_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+json_writer_t::json_writer_t(size_t reserve, int decimals_) : after_key(false), decimals(decimals_)
+{
+  buffer.reserve(reserve);
+}
+
+void json_writer_t::separator()
+{
+  if (after_key)
+  {
+    after_key = false;
+    return;
+  }
+  if (!first.empty())
+  {
+    if (!first.back())
+    {
+      buffer.push_back(',');
+    }
+    first.back() = false;
+  }
+}
+
+json_writer_t& json_writer_t::begin_object()
+{
+  separator();
+  buffer.push_back('{');
+  first.push_back(true);
+  return *this;
+}
+
+json_writer_t& json_writer_t::end_object()
+{
+  buffer.push_back('}');
+  first.pop_back();
+  return *this;
+}
+
+json_writer_t& json_writer_t::begin_array()
+{
+  separator();
+  buffer.push_back('[');
+  first.push_back(true);
+  return *this;
+}
+
+json_writer_t& json_writer_t::end_array()
+{
+  buffer.push_back(']');
+  first.pop_back();
+  return *this;
+}
+
+json_writer_t& json_writer_t::key(std::string_view name)
+{
+  separator();
+  append_json_string(buffer, name);
+  buffer.push_back(':');
+  after_key = true;
+  return *this;
+}
+
+json_writer_t& json_writer_t::value(std::string_view str)
+{
+  separator();
+  append_json_string(buffer, str);
+  return *this;
+}
+
+json_writer_t& json_writer_t::value(const char* str)
+{
+  return value(std::string_view(str));
+}
+
+json_writer_t& json_writer_t::value(const std::string& str)
+{
+  return value(std::string_view(str));
+}
+
+json_writer_t& json_writer_t::value(int64_t number)
+{
+  separator();
+  char buf[24];
+  std::to_chars_result result = std::to_chars(buf, buf + sizeof(buf), number);
+  buffer.append(buf, result.ptr - buf);
+  return *this;
+}
+
+json_writer_t& json_writer_t::value(int number)
+{
+  return value(static_cast<int64_t>(number));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// value(double)
+// shortest representation that round trips; JSON has no NaN or infinity, those are written as null
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+json_writer_t& json_writer_t::value(double number)
+{
+  if (!std::isfinite(number))
+  {
+    return null();
+  }
+  separator();
+  char buf[32];
+  std::to_chars_result result = std::to_chars(buf, buf + sizeof(buf), number);
+  buffer.append(buf, result.ptr - buf);
+  return *this;
+}
+
+json_writer_t& json_writer_t::value(bool flag)
+{
+  separator();
+  buffer.append(flag ? "true" : "false");
+  return *this;
+}
+
+json_writer_t& json_writer_t::null()
+{
+  separator();
+  buffer.append("null");
+  return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// fixed
+// fixed decimals, trailing zeros and a trailing point removed: 12.500000 is written as 12.5
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+json_writer_t& json_writer_t::fixed(double number)
+{
+  if (!std::isfinite(number))
+  {
+    return null();
+  }
+  separator();
+  char buf[64];
+  std::to_chars_result result = std::to_chars(buf, buf + sizeof(buf), number, std::chars_format::fixed, decimals);
+  if (result.ec != std::errc())
+  {
+    result = std::to_chars(buf, buf + sizeof(buf), number);
+  }
+  char* end = result.ptr;
+  if (decimals > 0)
+  {
+    while (end > buf && end[-1] == '0') end--;
+    if (end > buf && end[-1] == '.') end--;
+  }
+  if (end - buf == 2 && buf[0] == '-' && buf[1] == '0')
+  {
+    buf[0] = '0';
+    end = buf + 1;
+  }
+  buffer.append(buf, end - buf);
+  return *this;
+}
+
+json_writer_t& json_writer_t::json(std::string_view text)
+{
+  separator();
+  buffer.append(text.data(), text.size());
+  return *this;
+}
+
+json_writer_t& json_writer_t::raw(std::string_view text)
+{
+  buffer.append(text.data(), text.size());
+  return *this;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// flush
+// write out and empty the buffer, keeping its capacity and the open containers
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void json_writer_t::flush(std::ostream& out)
+{
+  out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  buffer.clear();
+}
+
+void json_writer_t::set_decimals(int decimals_)
+{
+  decimals = decimals_;
+}
+
+size_t json_writer_t::size() const
+{
+  return buffer.size();
+}
+
+const std::string& json_writer_t::str() const
+{
+  return buffer;
+}
+
+std::string json_writer_t::take()
+{
+  std::string out;
+  out.swap(buffer);
+  first.clear();
+  after_key = false;
+  return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_geojson_geometry
+// MultiPolygon at the writer's coordinate precision
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void write_geojson_geometry(json_writer_t& writer, const multipolygon_t& polygons)
+{
+  writer.begin_object();
+  writer.key("type").value("MultiPolygon");
+  writer.key("coordinates").begin_array();
+  for (size_t idx_polygon = 0; idx_polygon < polygons.size(); idx_polygon++)
+  {
+    writer.begin_array();
+    for (size_t idx_ring = 0; idx_ring < polygons[idx_polygon].size(); idx_ring++)
+    {
+      const ring_t& ring = polygons[idx_polygon][idx_ring];
+      writer.begin_array();
+      for (size_t idx = 0; idx < ring.size(); idx++)
+      {
+        writer.begin_array().fixed(ring[idx].x).fixed(ring[idx].y).end_array();
+      }
+      writer.end_array();
+    }
+    writer.end_array();
+  }
+  writer.end_array();
+  writer.end_object();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// megabytes_per_second
+// serialization throughput for logging
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+double megabytes_per_second(size_t bytes, std::chrono::steady_clock::duration elapsed)
+{
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  if (seconds <= 0)
+  {
+    return 0;
+  }
+  return bytes / 1e6 / seconds;
+}
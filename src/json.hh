@@ -0,0 +1,61 @@
+#ifndef ELECTIONS_JSON_HH
+#define ELECTIONS_JSON_HH
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include "geometry.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// json_writer_t
+// streaming JSON writer into one growable buffer; commas are inserted automatically between
+// values. Numbers use std::to_chars (locale free, shortest round trip); fixed() writes coordinates
+// and shares with a set number of decimals, trailing zeros trimmed. json() appends a pre-serialized
+// value, raw() appends JSON or JavaScript text without separators
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class json_writer_t
+{
+public:
+  json_writer_t(size_t reserve = 4096, int decimals = 6);
+
+  json_writer_t& begin_object();
+  json_writer_t& end_object();
+  json_writer_t& begin_array();
+  json_writer_t& end_array();
+  json_writer_t& key(std::string_view name);
+  json_writer_t& value(std::string_view str);
+  json_writer_t& value(const char* str);
+  json_writer_t& value(const std::string& str);
+  json_writer_t& value(int64_t number);
+  json_writer_t& value(int number);
+  json_writer_t& value(double number);
+  json_writer_t& value(bool flag);
+  json_writer_t& null();
+  json_writer_t& fixed(double number);
+  json_writer_t& json(std::string_view text);
+  json_writer_t& raw(std::string_view text);
+
+  void flush(std::ostream& out);
+  void set_decimals(int decimals);
+  size_t size() const;
+  const std::string& str() const;
+  std::string take();
+
+private:
+  std::string buffer;
+  std::vector<bool> first;  // per open container, true until the first element is written
+  bool after_key;
+  int decimals;
+
+  void separator();
+};
+
+void append_json_string(std::string& out, std::string_view str);
+void write_geojson_geometry(json_writer_t& writer, const multipolygon_t& polygons);
+double megabytes_per_second(size_t bytes, std::chrono::steady_clock::duration elapsed);
+
+#endif
@@ -0,0 +1,318 @@
+#include "live.hh"
+#include <map>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_set>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// live_feed_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+live_feed_t::live_feed_t(payload_cache_t& cache_, const updated_t& updated_, const post_t& post_, int tick_ms_)
+  : cache(cache_), updated(updated_), post(post_), tick_ms(tick_ms_), stopping(false)
+{
+  thread = std::thread(&live_feed_t::run, this);
+}
+
+live_feed_t::~live_feed_t()
+{
+  stop();
+}
+
+void live_feed_t::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  if (thread.joinable())
+  {
+    thread.join();
+  }
+}
+
+void live_feed_t::push(const std::vector<result_update>& updates)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  pending.insert(pending.end(), updates.begin(), updates.end());
+}
+
+void live_feed_t::subscribe(const std::string& session)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  sessions.insert(session);
+}
+
+void live_feed_t::unsubscribe(const std::string& session)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  sessions.erase(session);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// run
+// ticks at a fixed interval whether or not updates arrived, so bursts are batched
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void live_feed_t::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping)
+  {
+    wake.wait_for(lock, std::chrono::milliseconds(tick_ms));
+    if (stopping)
+    {
+      break;
+    }
+    lock.unlock();
+    tick();
+    lock.lock();
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tick
+// the last update of a county within a tick wins; one delta per year is serialized, then posted
+// to every session, which applies it only when showing that year
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void live_feed_t::tick()
+{
+  std::vector<result_update> batch;
+  std::vector<std::string> targets;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty())
+    {
+      return;
+    }
+    batch.swap(pending);
+    targets.assign(sessions.begin(), sessions.end());
+  }
+
+  std::map<int, std::map<std::string, result_update>> years;
+  for (size_t idx = 0; idx < batch.size(); idx++)
+  {
+    years[batch[idx].year][batch[idx].fips] = batch[idx];
+  }
+
+  for (std::map<int, std::map<std::string, result_update>>::const_iterator it = years.begin(); it != years.end(); ++it)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<result_update> updates;
+    for (std::map<std::string, result_update>::const_iterator it_update = it->second.begin(); it_update != it->second.end(); ++it_update)
+    {
+      updates.push_back(it_update->second);
+    }
+
+    // a failed year is reported and skipped; an exception must not end the live thread
+    std::shared_ptr<const year_payload_t> payload;
+    try
+    {
+      payload = cache.apply_updates(it->first, updates);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Live: " << e.what() << std::endl;
+    }
+    if (!payload)
+    {
+      std::cerr << "Live: " << updates.size() << " updates for " << it->first << " not applied" << std::endl;
+      continue;
+    }
+
+    std::chrono::steady_clock::time_point applied = std::chrono::steady_clock::now();
+
+    // changed counties, and the states containing them
+    const county_table_t& table = payload->counties;
+    std::vector<size_t> counties;
+    std::set<std::string> state_fips;
+    for (size_t idx = 0; idx < table.size(); idx++)
+    {
+      if (it->second.count(std::string(table.fips(idx))))
+      {
+        counties.push_back(idx);
+        state_fips.insert(table.state_fips(idx));
+      }
+    }
+    std::vector<state_record> states;
+    for (size_t idx = 0; idx < payload->states.size(); idx++)
+    {
+      if (state_fips.count(payload->states[idx].fips))
+      {
+        states.push_back(payload->states[idx]);
+      }
+    }
+
+    std::shared_ptr<live_delta_t> delta = std::make_shared<live_delta_t>();
+    delta->year = it->first;
+    delta->counties = counties.size();
+    delta->payload = payload;
+    delta->county_js = "window.us_elections.patch(" + make_attributes_json(table, counties) + ");";
+    delta->state_js = "window.us_elections.patch(" + make_attributes_json(states) + ");";
+
+    std::chrono::steady_clock::time_point serialized = std::chrono::steady_clock::now();
+
+    if (updated)
+    {
+      updated(*delta);
+    }
+    for (size_t idx = 0; idx < targets.size(); idx++)
+    {
+      post(targets[idx], delta);
+    }
+
+    std::cout << "Live " << it->first << ": " << updates.size() << " updates, " << delta->county_js.size()
+      << " bytes delta, apply " << std::chrono::duration_cast<std::chrono::milliseconds>(applied - start).count()
+      << " ms, serialize " << std::chrono::duration_cast<std::chrono::microseconds>(serialized - applied).count()
+      << " us, posted to " << targets.size() << " sessions in "
+      << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - serialized).count()
+      << " us" << std::endl;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_result_updates
+// CSV "year,fips,votes_gop,votes_dem,votes_total"; a first line that does not start with a digit
+// is a header. FIPS are zero padded to 5 digits as in the results table. The year must be loaded
+// and the county in its table, so the database and the served payload stay in step
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool parse_result_updates(std::istream& in, payload_cache_t& cache, std::vector<result_update>& updates, std::string& error)
+{
+  std::vector<int> years = cache.get_years();
+  std::map<int, std::unordered_set<uint32_t>> counties;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line))
+  {
+    line_number++;
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.pop_back();
+    }
+    if (line.empty() || (line_number == 1 && (line[0] < '0' || line[0] > '9')))
+    {
+      continue;
+    }
+
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ','))
+    {
+      fields.push_back(field);
+    }
+
+    bool valid = fields.size() == 5;
+    int64_t values[5] = { 0, 0, 0, 0, 0 };
+    for (size_t idx = 0; valid && idx < fields.size(); idx++)
+    {
+      char* end = nullptr;
+      values[idx] = std::strtoll(fields[idx].c_str(), &end, 10);
+      valid = !fields[idx].empty() && *end == '\0' && values[idx] >= 0;
+    }
+    if (valid)
+    {
+      valid = fields[1].size() <= 5 && values[4] >= values[2] + values[3];
+    }
+    if (!valid)
+    {
+      error = "line " + std::to_string(line_number) + ": expected year,fips,votes_gop,votes_dem,votes_total";
+      return false;
+    }
+
+    if (std::find(years.begin(), years.end(), values[0]) == years.end())
+    {
+      error = "line " + std::to_string(line_number) + ": year " + fields[0] + " is not loaded";
+      return false;
+    }
+    std::map<int, std::unordered_set<uint32_t>>::iterator it_year = counties.find(static_cast<int>(values[0]));
+    if (it_year == counties.end())
+    {
+      std::shared_ptr<const year_payload_t> payload = cache.get(static_cast<int>(values[0]));
+      it_year = counties.emplace(static_cast<int>(values[0]), std::unordered_set<uint32_t>()).first;
+      if (payload)
+      {
+        it_year->second.insert(payload->counties.id.begin(), payload->counties.id.end());
+      }
+    }
+    if (!it_year->second.count(static_cast<uint32_t>(values[1])))
+    {
+      error = "line " + std::to_string(line_number) + ": county " + fields[1] + " has no results in " + fields[0];
+      return false;
+    }
+
+    result_update u;
+    u.year = static_cast<int>(values[0]);
+    u.fips = std::string(5 - fields[1].size(), '0') + fields[1];
+    u.votes_gop = values[2];
+    u.votes_dem = values[3];
+    u.votes_total = values[4];
+    updates.push_back(u);
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ingest_resource_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ingest_resource_t::ingest_resource_t(live_feed_t& feed_, payload_cache_t& cache_, const std::string& token_)
+  : feed(feed_), cache(cache_), token(token_)
+{
+}
+
+ingest_resource_t::~ingest_resource_t()
+{
+  beingDeleted();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// handleRequest
+// the token comparison does not stop at the first differing byte
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ingest_resource_t::handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+  response.setMimeType("text/plain");
+  if (request.method() != "POST")
+  {
+    response.setStatus(405);
+    response.addHeader("Allow", "POST");
+    return;
+  }
+
+  const std::string prefix = "Bearer ";
+  std::string authorization = request.headerValue("Authorization");
+  bool authorized = !token.empty() && authorization.size() == prefix.size() + token.size() &&
+    authorization.compare(0, prefix.size(), prefix) == 0;
+  unsigned char diff = 0;
+  for (size_t idx = 0; authorized && idx < token.size(); idx++)
+  {
+    diff |= static_cast<unsigned char>(authorization[prefix.size() + idx] ^ token[idx]);
+  }
+  if (!authorized || diff != 0)
+  {
+    response.setStatus(401);
+    return;
+  }
+
+  std::vector<result_update> updates;
+  std::string error;
+  if (!parse_result_updates(request.in(), cache, updates, error))
+  {
+    response.setStatus(400);
+    response.out() << error << "\n";
+    return;
+  }
+
+  feed.push(updates);
+  response.setStatus(202);
+  response.out() << updates.size() << " updates queued\n";
+}
@@ -0,0 +1,91 @@
+#ifndef ELECTIONS_LIVE_HH
+#define ELECTIONS_LIVE_HH
+
+#include <Wt/WResource.h>
+#include <Wt/Http/Request.h>
+#include <Wt/Http/Response.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include "payload.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// live_delta_t
+// one tick of live results for a year, serialized once and shared by every session:
+// JavaScript patching only the changed counties, or the changed states for the state view
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct live_delta_t
+{
+  int year = 0;
+  size_t counties = 0;
+  std::string county_js;
+  std::string state_js;
+  std::shared_ptr<const year_payload_t> payload;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// live_feed_t
+// ingested updates are queued and applied on a fixed tick: the database and the year payload are
+// updated once, the delta is serialized once, then posted to each subscribed session
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class live_feed_t
+{
+public:
+  typedef std::function<void(const live_delta_t&)> updated_t;
+  typedef std::function<void(const std::string&, const std::shared_ptr<const live_delta_t>&)> post_t;
+
+  live_feed_t(payload_cache_t& cache, const updated_t& updated, const post_t& post, int tick_ms);
+  ~live_feed_t();
+
+  void push(const std::vector<result_update>& updates);
+  void subscribe(const std::string& session);
+  void unsubscribe(const std::string& session);
+  void stop();
+
+private:
+  payload_cache_t& cache;
+  updated_t updated;
+  post_t post;
+  int tick_ms;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping;
+  std::vector<result_update> pending;
+  std::set<std::string> sessions;
+  std::thread thread;
+
+  void run();
+  void tick();
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ingest_resource_t
+// POST of CSV lines "year,fips,votes_gop,votes_dem,votes_total" (header line optional);
+// requires "Authorization: Bearer <token>". Replies 202 once the updates are queued, 400 with the
+// line number when a line is malformed or names a year or county that is not loaded
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ingest_resource_t : public Wt::WResource
+{
+public:
+  ingest_resource_t(live_feed_t& feed, payload_cache_t& cache, const std::string& token);
+  ~ingest_resource_t();
+
+  virtual void handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+
+private:
+  live_feed_t& feed;
+  payload_cache_t& cache;
+  std::string token;
+};
+
+bool parse_result_updates(std::istream& in, payload_cache_t& cache, std::vector<result_update>& updates, std::string& error);
+
+#endif
@@ -1,44 +1,522 @@
 #include "data.hh"
+#include "tiles.hh"
+#include "payload.hh"
+#include "snapshot.hh"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_manifest
+// one "year,csv_path" per line, # starts a comment; relative paths are relative to the manifest
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool read_manifest(const std::string& path, std::vector<election_file>& files)
+{
+  std::ifstream file(path);
+  if (!file.is_open())
+  {
+    std::cerr << "Cannot open manifest " << path << std::endl;
+    return false;
+  }
+
+  std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line))
+  {
+    line_number++;
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    line.erase(0, line.find_first_not_of(" \t\r"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty()) continue;
+
+    size_t comma = line.find(',');
+    char* end = nullptr;
+    election_file entry;
+    entry.year = (comma == std::string::npos) ? 0 : static_cast<int>(std::strtol(line.c_str(), &end, 10));
+    if (comma == std::string::npos || end != line.c_str() + comma || line.find_first_not_of(" \t", comma + 1) == std::string::npos)
+    {
+      std::cerr << path << ": line " << line_number << ": expected year,csv_path" << std::endl;
+      return false;
+    }
+    std::filesystem::path csv = line.substr(line.find_first_not_of(" \t", comma + 1));
+    entry.path = csv.is_absolute() ? csv.string() : (directory / csv).string();
+    files.push_back(entry);
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_years
+// comma separated list of years
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool read_years(const std::string& list, std::vector<int>& years)
+{
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    char* end = nullptr;
+    long year = std::strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0')
+    {
+      std::cerr << "Invalid year '" << item << "' in --years" << std::endl;
+      return false;
+    }
+    years.push_back(static_cast<int>(year));
+  }
+  return !years.empty();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bench_sessions
+// session startups of a year on the calling thread, as a server process without the year cached
+// reads them: the county, state and national queries. Returns the number of startups run
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int64_t bench_sessions(database_t& db, int year, int iterations)
+{
+  int64_t startups = 0;
+  for (int it = 0; it < iterations; it++)
+  {
+    county_table_t counties = db.get_counties(year);
+    std::vector<state_record> states = db.get_states(year);
+    national_record national = db.get_national(year);
+    if (counties.id.empty() || states.empty() || national.votes_total <= 0)
+    {
+      break;
+    }
+    startups++;
+  }
+  return startups;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// bench_processes
+// session startups of the latest year in 1, 2, 4 ... max_processes processes at once, as separate
+// elections processes would run them: each forks, opens the file read-only with its own DuckDB
+// instance, runs one startup and reports ready, failed or not. The processes then start together
+// on a pipe barrier. Reports the startups of all processes over the wall time from the barrier to
+// the last result, and the scaling over one process. The caller must not hold the file open
+// read-write. POSIX only
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void bench_processes(const std::string& db_path, int max_processes, int iterations)
+{
+#ifdef _WIN32
+  (void)db_path;
+  (void)max_processes;
+  (void)iterations;
+  std::cerr << "Process benchmark not available on Windows" << std::endl;
+#else
+  if (iterations < 1) iterations = 1;
+  if (max_processes < 1) max_processes = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+  int year = 0;
+  {
+    database_t db(db_path, 1, true);
+    std::vector<int> years = db.get_years();
+    if (years.empty())
+    {
+      std::cerr << "No results in " << db_path << std::endl;
+      return;
+    }
+    year = *std::max_element(years.begin(), years.end());
+  }
+
+  std::vector<int> counts;
+  for (int processes = 1; processes < max_processes; processes *= 2)
+  {
+    counts.push_back(processes);
+  }
+  counts.push_back(max_processes);
+
+  std::cout << "Session startups, " << year << ", " << iterations << " per process, read-only" << std::endl;
+
+  double base = 0;
+  for (size_t count = 0; count < counts.size(); count++)
+  {
+    int processes = counts[count];
+
+    // the barrier: children block reading it until the parent closes the write end
+    int barrier[2];
+    if (pipe(barrier) != 0)
+    {
+      std::cerr << "pipe failed" << std::endl;
+      return;
+    }
+
+    std::vector<pid_t> children;
+    std::vector<int> pipes;
+    std::cout << std::flush;
+    for (int idx = 0; idx < processes; idx++)
+    {
+      int fds[2];
+      if (pipe(fds) != 0)
+      {
+        std::cerr << "pipe failed" << std::endl;
+        break;
+      }
+      pid_t pid = fork();
+      if (pid == 0)
+      {
+        close(fds[0]);
+        close(barrier[1]);
+        std::unique_ptr<database_t> db;
+        try
+        {
+          db = std::make_unique<database_t>(db_path, 1, true);
+          bench_sessions(*db, year, 1);
+        }
+        catch (const std::exception& e)
+        {
+          std::cerr << e.what() << std::endl;
+          db.reset();
+        }
+
+        // ready on every path, so the parent always reads one byte and then the count
+        char ready = 1;
+        char go = 0;
+        int64_t startups = 0;
+        ssize_t bytes = write(fds[1], &ready, sizeof(ready));
+        (void)bytes;
+        if (read(barrier[0], &go, sizeof(go)) == 0 && db)
+        {
+          try
+          {
+            startups = bench_sessions(*db, year, iterations);
+          }
+          catch (const std::exception& e)
+          {
+            std::cerr << e.what() << std::endl;
+          }
+        }
+        bytes = write(fds[1], &startups, sizeof(startups));
+        (void)bytes;
+        close(fds[1]);
+        close(barrier[0]);
+        _exit(0);
+      }
+      close(fds[1]);
+      if (pid < 0)
+      {
+        close(fds[0]);
+        std::cerr << "fork failed" << std::endl;
+        break;
+      }
+      children.push_back(pid);
+      pipes.push_back(fds[0]);
+    }
+    close(barrier[0]);
+
+    // wait until every child has opened the file and run a first startup, then release them together
+    for (size_t idx = 0; idx < children.size(); idx++)
+    {
+      char ready = 0;
+      ssize_t bytes = read(pipes[idx], &ready, sizeof(ready));
+      (void)bytes;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    close(barrier[1]);
+
+    int64_t startups = 0;
+    for (size_t idx = 0; idx < children.size(); idx++)
+    {
+      int64_t child_startups = 0;
+      if (read(pipes[idx], &child_startups, sizeof(child_startups)) == static_cast<ssize_t>(sizeof(child_startups)))
+      {
+        startups += child_startups;
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t idx = 0; idx < children.size(); idx++)
+    {
+      close(pipes[idx]);
+      waitpid(children[idx], nullptr, 0);
+    }
+
+    double rate = (seconds > 0) ? startups / seconds : 0;
+    if (count == 0)
+    {
+      base = rate;
+    }
+
+    std::cout << "  " << children.size() << " processes: " << startups << " startups, "
+      << static_cast<int64_t>(rate) << "/s (" << static_cast<int64_t>(base > 0 ? 100 * rate / base : 0)
+      << "%)" << std::endl;
+  }
+#endif
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // main
-// ./loader <topojson> <csv_file> <year> [db]
+// ./loader <topojson> <csv_file> <year> [db] [--tiles <max_zoom>] [--export <geojson>] [--bench <iterations>]
+// ./loader <topojson> --manifest <file> [db] [--threads <n>] [--force] [...]
+// ./loader --import-parquet <dir> [db] [--years <y1,y2,...>] [...]
+// ./loader --export-parquet <dir> [db]
+// ./loader --snapshot <file> [db]
+// ./loader --bench-processes <n> [db] [--bench <iterations>]
 // ./loader counties-10m.json 2024_US_County_Level_Presidential_Results.csv 2024 elections.duckdb
+// --manifest loads every year it lists, parsed in parallel on --threads (default all cores)
+// geometry and its simplified levels are reloaded only when the topojson contents changed,
+// or with --force
+// --import-parquet loads a directory written by --export-parquet instead of topojson and CSV,
+// all its years or those of --years; --export-parquet writes the database to a directory after
+// any load, or on its own
+// --snapshot writes what the server builds at startup (payloads, compressed variants, geometry
+// documents, shapes, tiles) to a file the server maps with ELECTIONS_SNAPSHOT; after any load,
+// or on its own
+// --tiles pre-generates vector tiles from zoom 0 to max_zoom into the tiles table
+// --export writes the year as a GeoJSON FeatureCollection and reports the write throughput
+// --bench times the read queries for the year, ad hoc against prepared statements, the
+// extraction of county records from the result chunks, Value against columnar, and concurrent
+// session startups, one shared connection against the connection pool
+// --bench-processes times session startups (the year queries) in 1, 2, 4 ... n processes
+// started together, each with the database opened read-only as ELECTIONS_READ_ONLY servers open
+// it; --bench iterations per process, default 100
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
 int main(int argc, char* argv[])
 {
-  if (argc < 4)
+  std::vector<std::string> args;
+  int tiles_zoom = -1;
+  std::string export_path;
+  int bench_iterations = 0;
+  std::string manifest_path;
+  int threads = 0;
+  bool force = false;
+  std::string import_parquet;
+  std::string export_parquet;
+  std::vector<int> years;
+  std::string snapshot_path;
+  int process_count = 0;
+  for (int idx = 1; idx < argc; idx++)
+  {
+    std::string arg = argv[idx];
+    if (arg == "--tiles" && idx + 1 < argc)
+    {
+      tiles_zoom = std::stoi(argv[++idx]);
+    }
+    else if (arg == "--export" && idx + 1 < argc)
+    {
+      export_path = argv[++idx];
+    }
+    else if (arg == "--bench" && idx + 1 < argc)
+    {
+      bench_iterations = std::stoi(argv[++idx]);
+    }
+    else if (arg == "--manifest" && idx + 1 < argc)
+    {
+      manifest_path = argv[++idx];
+    }
+    else if (arg == "--threads" && idx + 1 < argc)
+    {
+      threads = std::stoi(argv[++idx]);
+    }
+    else if (arg == "--force")
+    {
+      force = true;
+    }
+    else if (arg == "--import-parquet" && idx + 1 < argc)
+    {
+      import_parquet = argv[++idx];
+    }
+    else if (arg == "--export-parquet" && idx + 1 < argc)
+    {
+      export_parquet = argv[++idx];
+    }
+    else if (arg == "--snapshot" && idx + 1 < argc)
+    {
+      snapshot_path = argv[++idx];
+    }
+    else if (arg == "--bench-processes" && idx + 1 < argc)
+    {
+      process_count = std::stoi(argv[++idx]);
+    }
+    else if (arg == "--years" && idx + 1 < argc)
+    {
+      if (!read_years(argv[++idx], years))
+      {
+        return 1;
+      }
+    }
+    else
+    {
+      args.push_back(arg);
+    }
+  }
+
+  std::vector<election_file> files;
+  if (!manifest_path.empty() && !read_manifest(manifest_path, files))
+  {
+    return 1;
+  }
+
+  // a Parquet import, or a Parquet or snapshot export or process benchmark of an existing
+  // database, takes no topojson or CSV
+  bool export_only = (!export_parquet.empty() || !snapshot_path.empty() || process_count > 0) &&
+    manifest_path.empty() && args.size() <= 1;
+  bool no_sources = !import_parquet.empty() || export_only;
+
+  if (no_sources ? args.size() > 1 :
+    (args.empty() || (manifest_path.empty() && args.size() < 3) || (!manifest_path.empty() && files.empty())))
   {
-    std::cout << "Usage: " << argv[0] << " <topojson> <csv_file> <year> [db]\n";
+    std::cout << "Usage: " << argv[0] << " <topojson> <csv_file> <year> [db] [--tiles <max_zoom>] [--export <geojson>] [--bench <iterations>]\n";
+    std::cout << "       " << argv[0] << " <topojson> --manifest <file> [db] [--threads <n>] [--force] [...]\n";
+    std::cout << "       " << argv[0] << " --import-parquet <dir> [db] [--years <y1,y2,...>] [...]\n";
+    std::cout << "       " << argv[0] << " --export-parquet <dir> [db]\n";
+    std::cout << "       " << argv[0] << " --snapshot <file> [db]\n";
+    std::cout << "       " << argv[0] << " --bench-processes <n> [db] [--bench <iterations>]\n";
     return 1;
   }
 
-  std::string json_path = argv[1];
-  std::string csv_path = argv[2];
-  int year = std::stoi(argv[3]);
-  std::string db_path = (argc > 4) ? argv[4] : "elections.duckdb";
+  std::string json_path;
+  std::string db_path;
+  int year = 0;
+  if (no_sources)
+  {
+    db_path = args.empty() ? "elections.duckdb" : args[0];
+  }
+  else if (manifest_path.empty())
+  {
+    json_path = args[0];
+    election_file entry;
+    entry.path = args[1];
+    entry.year = year = std::stoi(args[2]);
+    files.push_back(entry);
+    db_path = (args.size() > 3) ? args[3] : "elections.duckdb";
+  }
+  else
+  {
+    json_path = args[0];
+    for (size_t idx = 0; idx < files.size(); idx++)
+    {
+      year = std::max(year, files[idx].year);
+    }
+    db_path = (args.size() > 1) ? args[1] : "elections.duckdb";
+  }
+
+  // the benchmark processes open the file read-only, which DuckDB refuses while this process
+  // holds it open read-write
+  if (process_count > 0)
+  {
+    if (!export_only || !export_parquet.empty() || !snapshot_path.empty())
+    {
+      std::cerr << "--bench-processes runs on its own, against a loaded database" << std::endl;
+      return 1;
+    }
+    bench_processes(db_path, process_count, bench_iterations > 0 ? bench_iterations : 100);
+    return 0;
+  }
 
   database_t db(db_path);
+  db.print_startup_timing();
 
-  int geo_count = db.load_topojson(json_path);
-  if (geo_count <= 0)
+  if (!import_parquet.empty())
   {
-    return 1;
+    int parquet_count = db.import_parquet(import_parquet, years);
+    if (parquet_count <= 0)
+    {
+      return 1;
+    }
+
+    std::cout << "Results imported: " << parquet_count << std::endl;
+  }
+  else if (!no_sources)
+  {
+    bool geometry_loaded = !force && db.is_loaded(json_path);
+    if (geometry_loaded)
+    {
+      std::cout << "Counties unchanged since the last load of " << json_path << ", not reloaded" << std::endl;
+    }
+    else
+    {
+      int geo_count = db.load_topojson(json_path);
+      if (geo_count <= 0)
+      {
+        return 1;
+      }
+
+      std::cout << "Counties loaded: " << geo_count << std::endl;
+    }
+
+    int csv_count = manifest_path.empty() ? db.load_election_csv(files[0].path, year) : db.load_election_files(files, threads);
+    if (csv_count <= 0)
+    {
+      return 1;
+    }
+
+    std::cout << "Results loaded: " << csv_count << std::endl;
+
+    // the counties count as loaded only with their levels, so a failed run is redone
+    if (!geometry_loaded && db.build_levels() < 0)
+    {
+      std::cerr << "Simplification levels not built; the server will use full resolution" << std::endl;
+      db.build_geojson();
+    }
+    else if (!geometry_loaded)
+    {
+      db.set_loaded(json_path);
+    }
+  }
+
+  if (year == 0)
+  {
+    std::vector<int> loaded = years.empty() ? db.get_years() : years;
+    if (loaded.empty())
+    {
+      std::cerr << "No results in " << db_path << std::endl;
+      return 1;
+    }
+    year = *std::max_element(loaded.begin(), loaded.end());
+  }
+
+  if (tiles_zoom >= 0)
+  {
+    tile_source_t source(db.get_shapes(), "", 0);
+    db.save_tiles(source.generate(tiles_zoom));
   }
 
-  std::cout << "Counties loaded: " << geo_count << std::endl;
+  if (!export_path.empty() && db.export_geojson(year, export_path) < 0)
+  {
+    std::cerr << "Cannot write " << export_path << std::endl;
+  }
 
-  int csv_count = db.load_election_csv(csv_path, year);
-  if (csv_count <= 0)
+  if (!export_parquet.empty() && db.export_parquet(export_parquet) < 0)
   {
+    std::cerr << "Cannot write " << export_parquet << std::endl;
     return 1;
   }
 
-  std::cout << "Results loaded: " << csv_count << std::endl;
+  if (!snapshot_path.empty())
+  {
+    payload_cache_t cache(db);
+    if (write_snapshot(snapshot_path, cache, db) < 0)
+    {
+      return 1;
+    }
+  }
 
   db.print_summary(year);
 
+  if (bench_iterations > 0)
+  {
+    db.bench_queries(year, bench_iterations);
+    db.bench_extraction(year, bench_iterations);
+    db.bench_concurrency(year, bench_iterations);
+  }
+
   return 0;
 }
@@ -1,10 +1,13 @@
 #include "map.hh"
+#include "topology.hh"
+#include "json.hh"
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -55,46 +58,6 @@ std::string load_geojson(const std::string& name)
   return str;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-// escape_js_string
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-
-std::string escape_js_string(const std::string& input)
-{
-  std::string output;
-  output.reserve(input.size());
-  for (size_t idx = 0; idx < input.size(); ++idx)
-  {
-    char c = input[idx];
-    switch (c)
-    {
-    case '\'': output += "\\'"; break;
-    case '\"': output += "\\\""; break;
-    case '\\': output += "\\\\"; break;
-    case '\n': output += "\\n"; break;
-    case '\r': output += "\\r"; break;
-    case '\t': output += "\\t"; break;
-    default: output += c; break;
-    }
-  }
-  return output;
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-// margin_to_color
-// margin: positive = gop (red), negative = dem (blue)
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-
-std::string margin_to_color(double margin)
-{
-  if (margin > 0.3334) return "#B82D35";      // strong gop
-  if (margin > 0.1667) return "#E48268";      // lean gop
-  if (margin > 0.0)    return "#FACCB4";      // slight gop
-  if (margin > -0.1667) return "#BFDCEB";     // slight dem
-  if (margin > -0.3334) return "#6BACD0";     // lean dem
-  return "#2A71AE";                           // strong dem
-}
-
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // WMapLibre
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -119,7 +82,8 @@ namespace Wt
   }
 
   WMapLibre::WMapLibre()
-    : current_year(2024), view_mode("county"), counties(nullptr), states(nullptr)
+    : current_year(2024), view_mode("county"), source_mode("geojson"), geometry_level(level_for_zoom(4)), zoom(4),
+    zoom_changed(this, "zoom_changed")
   {
     setImplementation(std::unique_ptr<Impl>(impl = new Impl()));
     WApplication* app = WApplication::instance();
@@ -128,6 +92,7 @@ namespace Wt
     app->useStyleSheet("https://unpkg.com/maplibre-gl@4.7.1/dist/maplibre-gl.css");
     app->require("https://unpkg.com/maplibre-gl@4.7.1/dist/maplibre-gl.js", "maplibre");
     app->require("https://unpkg.com/@turf/turf@6/turf.min.js", "turf");
+    zoom_changed.connect(this, &WMapLibre::on_zoom);
   }
 
   WMapLibre::~WMapLibre()
@@ -144,9 +109,113 @@ namespace Wt
     view_mode = mode;
   }
 
+  void WMapLibre::set_source_mode(const std::string& mode)
+  {
+    source_mode = mode;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // geometry_format
+  // how the client decodes geometry_urls; state boundaries are a single GeoJSON document
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  std::string WMapLibre::geometry_format() const
+  {
+    if (view_mode == "state" || source_mode == "mvt" || source_mode == "raster")
+    {
+      return "geojson";
+    }
+    return source_mode;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // attributes
+  // inline rows for the current view; no swing rows (the earliest year) leave the map uncolored
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  std::string_view WMapLibre::attributes() const
+  {
+    if (view_mode == "swing")
+    {
+      return swing ? swing->body() : "[]";
+    }
+    if (!payload)
+    {
+      return "[]";
+    }
+    return view_mode == "state" ? payload->state_attributes.body() : payload->attributes.body();
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // refresh_geometry
+  // after a view switch: geometry_urls holds the new view's documents, loaded into the same
+  // source; the attributes of the new view follow with refresh_data
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  void WMapLibre::refresh_geometry()
+  {
+    if (geometry_urls.empty() || source_mode == "mvt" || source_mode == "raster")
+    {
+      return;
+    }
+    geometry_level = view_mode == "state" ? 0 : level_for_zoom(zoom);
+    if (geometry_level >= static_cast<int>(geometry_urls.size()))
+    {
+      geometry_level = static_cast<int>(geometry_urls.size()) - 1;
+    }
+    json_writer_t js(256);
+    js.raw("window.us_elections.format = ").value(geometry_format()).raw(";");
+    js.raw("window.us_elections.load(").value(geometry_urls[geometry_level]).raw(");");
+    doJavaScript(js.take());
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // refresh_data
+  // incremental update: geometry stays loaded client side, only the per-year attributes (or the
+  // swing rows of the year pair) are fetched, as a cacheable pre-compressed resource
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
   void WMapLibre::refresh_data()
   {
-    scheduleRender();
+    if (!payload)
+    {
+      return;
+    }
+    json_writer_t js(256);
+    if (source_mode == "raster")
+    {
+      js.raw("window.us_elections.set_tiles(").value(raster_url).raw(");");
+    }
+    else if (attributes_url.empty())
+    {
+      js.raw("window.us_elections.apply(").raw(attributes()).raw(", ").value(view_mode).raw(");");
+    }
+    else
+    {
+      js.raw("window.us_elections.fetch_rows(").value(attributes_url).raw(", ").value(view_mode).raw(");");
+    }
+    doJavaScript(js.take());
+  }
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+  // on_zoom
+  // swap the geometry document for the simplification level of the new zoom; feature state is
+  // keyed by id and survives setData. Vector tiles carry their own per-zoom simplification, the
+  // state view has a single level
+  /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  void WMapLibre::on_zoom(int zoom_)
+  {
+    zoom = zoom_;
+    int level = level_for_zoom(zoom);
+    if (source_mode == "mvt" || source_mode == "raster" || view_mode == "state" || level == geometry_level || level >= static_cast<int>(geometry_urls.size()))
+    {
+      return;
+    }
+    geometry_level = level;
+    json_writer_t js(256);
+    js.raw("window.us_elections.load(").value(geometry_urls[level]).raw(");");
+    doJavaScript(js.take());
   }
 
   /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -159,131 +228,281 @@ namespace Wt
 
     if (flags.test(RenderFlag::Full))
     {
-      std::stringstream js;
+      bool vector_tiles = (source_mode == "mvt");
+      bool raster = (source_mode == "raster");
+      json_writer_t js(16384 + (raster ? 0 : attributes().size()));
+      std::string source_layer = vector_tiles ? "'source-layer':'counties', " : "";
 
       /////////////////////////////////////////////////////////////////////////////////////////////////////
       // create map
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "if (window.map) { window.map.remove(); }\n";
-      js << "window.map = new maplibregl.Map({\n"
-         << "  container: " << jsRef() << ",\n"
-         << "  style: 'https://basemaps.cartocdn.com/gl/positron-gl-style/style.json',\n"
-         << "  center: [-98, 39],\n"
-         << "  zoom: 4\n"
-         << "});\n"
-         << "window.map.addControl(new maplibregl.NavigationControl());\n";
+      js.raw("if (window.map) { window.map.remove(); }\n");
+      js.raw("window.map = new maplibregl.Map({\n")
+         .raw("  container: ").raw(jsRef()).raw(",\n")
+         .raw("  style: 'https://basemaps.cartocdn.com/gl/positron-gl-style/style.json',\n")
+         .raw("  center: [-98, 39],\n")
+         .raw("  zoom: 4\n")
+         .raw("});\n")
+         .raw("window.map.addControl(new maplibregl.NavigationControl());\n");
 
 #ifdef _WIN32
       OutputDebugStringA(js.str().c_str());
 #endif
 
-      js << "window.map.on('load', function() {\n";
-
       /////////////////////////////////////////////////////////////////////////////////////////////////////
-      // build geojson from database
+      // per-year attributes are applied as feature state, keyed by numeric FIPS;
+      // rows received before the source exists are kept and applied on load. On a year switch
+      // only the latest requested year is applied. Live deltas patch single rows. In the swing
+      // view the rows are margin, share and turnout changes, set as their own state so the fill
+      // switches to the swing palette
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "var geojson = {type:'FeatureCollection',features:[\n";
+      js.raw("window.us_elections = {\n")
+         .raw("  rows: [],\n")
+         .raw("  view: ").value(view_mode).raw(",\n")
+         .raw("  target: {source:'counties'").raw(vector_tiles ? ", sourceLayer:'counties'" : "").raw("},\n")
+         .raw("  apply: function(rows, view) {\n")
+         .raw("    var map = window.map;\n")
+         .raw("    var t = this.target;\n")
+         .raw("    this.rows = rows;\n")
+         .raw("    if (view) { this.view = view; }\n")
+         .raw("    if (!map.getSource(t.source)) { return; }\n")
+         .raw("    map.removeFeatureState(t);\n")
+         .raw("    for (var i = 0; i < rows.length; i++) { this.set(rows[i]); }\n")
+         .raw("  },\n")
+         .raw("  set: function(r) {\n")
+         .raw("    var t = this.target;\n")
+         .raw("    var f = {source:t.source, sourceLayer:t.sourceLayer, id:r[0]};\n")
+         .raw("    if (this.view === 'swing') {\n")
+         .raw("      window.map.setFeatureState(f, {swing:r[1], gop_shift:r[2], dem_shift:r[3], turnout:r[4], total_change:r[5]});\n")
+         .raw("    } else {\n")
+         .raw("      window.map.setFeatureState(f, {gop:r[1], dem:r[2], total:r[3], per_gop:r[4], per_dem:r[5], margin:r[4] - r[5]});\n")
+         .raw("    }\n")
+         .raw("  },\n")
+         .raw("  patch: function(rows) {\n")
+         .raw("    var index = {};\n")
+         .raw("    for (var i = 0; i < this.rows.length; i++) { index[this.rows[i][0]] = i; }\n")
+         .raw("    var loaded = !!window.map.getSource(this.target.source);\n")
+         .raw("    for (var i = 0; i < rows.length; i++) {\n")
+         .raw("      var r = rows[i];\n")
+         .raw("      if (r[0] in index) { this.rows[index[r[0]]] = r; } else { this.rows.push(r); }\n")
+         .raw("      if (loaded) { this.set(r); }\n")
+         .raw("    }\n")
+         .raw("  },\n")
+         .raw("  fetch_rows: function(url, view) {\n")
+         .raw("    var self = this;\n")
+         .raw("    this.pending = url;\n")
+         .raw("    fetch(url).then(function(r) { return r.json(); }).then(function(rows) {\n")
+         .raw("      if (self.pending === url) { self.apply(rows, view); }\n")
+         .raw("    });\n")
+         .raw("  },\n");
 
-      if (counties && !counties->empty())
+      /////////////////////////////////////////////////////////////////////////////////////////////////////
+      // geometry loader; GeoJSON is fetched and parsed by MapLibre. TopoJSON and the binary format
+      // are fetched and decoded to GeoJSON objects here, timings are logged to the console.
+      // TopoJSON arcs are delta-decoded once, rings are stitched from arcs dropping the point
+      // shared with the previous arc. Binary coordinates are read through an Int32Array view
+      /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+      js.raw("  set_tiles: function(url) {\n")
+         .raw("    var src = window.map.getSource('counties');\n")
+         .raw("    this.tiles = window.location.origin + url;\n")
+         .raw("    if (src) { src.setTiles([this.tiles]); }\n")
+         .raw("  },\n");
+
+      js.raw("  format: ").value(geometry_format()).raw(",\n")
+         .raw("  load: function(url) {\n")
+         .raw("    var src = window.map.getSource('counties');\n")
+         .raw("    if (!src) { return; }\n")
+         .raw("    var self = this;\n")
+         .raw("    this.t0 = performance.now();\n")
+         .raw("    if (this.format === 'geojson') { src.setData(window.location.origin + url); return; }\n")
+         .raw("    var binary = (this.format === 'binary');\n")
+         .raw("    fetch(url).then(function(r) { return binary ? r.arrayBuffer() : r.json(); }).then(function(data) {\n")
+         .raw("      var t1 = performance.now();\n")
+         .raw("      var fc = binary ? self.decode_binary(data) : self.decode(data);\n")
+         .raw("      console.log(self.format + ' fetch ' + (t1 - self.t0).toFixed(1) + ' ms, decode ' +\n")
+         .raw("        (performance.now() - t1).toFixed(1) + ' ms');\n")
+         .raw("      src.setData(fc);\n")
+         .raw("    });\n")
+         .raw("  },\n")
+         .raw("  ready: function() {\n")
+         .raw("    if (this.t0 && window.map.querySourceFeatures('counties').length > 0) {\n")
+         .raw("      console.log(this.format + ' geometry ready ' + (performance.now() - this.t0).toFixed(1) + ' ms');\n")
+         .raw("      this.t0 = 0;\n")
+         .raw("    }\n")
+         .raw("  },\n")
+         .raw("  decode_binary: function(buffer) {\n")
+         .raw("    var v = new DataView(buffer);\n")
+         .raw("    if (v.getUint32(0, true) !== 0x42455355) { throw new Error('not a USEB buffer'); }\n")
+         .raw("    var nf = v.getUint32(8, true), np = v.getUint32(12, true), nr = v.getUint32(16, true), nc = v.getUint32(20, true);\n")
+         .raw("    var sx = v.getFloat64(24, true), sy = v.getFloat64(32, true);\n")
+         .raw("    var tx = v.getFloat64(40, true), ty = v.getFloat64(48, true);\n")
+         .raw("    var nl = v.getUint32(56, true), o = 60;\n")
+         .raw("    var ids = new Int32Array(buffer, o, nf); o += 4 * nf;\n")
+         .raw("    var fp = new Uint32Array(buffer, o, nf + 1); o += 4 * (nf + 1);\n")
+         .raw("    var pr = new Uint32Array(buffer, o, np + 1); o += 4 * (np + 1);\n")
+         .raw("    var rp = new Uint32Array(buffer, o, nr + 1); o += 4 * (nr + 1);\n")
+         .raw("    var xy = new Int32Array(buffer, o, 2 * nc); o += 8 * nc;\n")
+         .raw("    var labels = JSON.parse(new TextDecoder().decode(new Uint8Array(buffer, o, nl)));\n")
+         .raw("    var features = new Array(nf);\n")
+         .raw("    for (var f = 0; f < nf; f++) {\n")
+         .raw("      var polygons = [];\n")
+         .raw("      for (var p = fp[f]; p < fp[f + 1]; p++) {\n")
+         .raw("        var rings = [];\n")
+         .raw("        for (var r = pr[p]; r < pr[p + 1]; r++) {\n")
+         .raw("          var ring = new Array(rp[r + 1] - rp[r]);\n")
+         .raw("          for (var i = rp[r], k = 0; i < rp[r + 1]; i++, k++) { ring[k] = [xy[2 * i] * sx + tx, xy[2 * i + 1] * sy + ty]; }\n")
+         .raw("          rings.push(ring);\n")
+         .raw("        }\n")
+         .raw("        polygons.push(rings);\n")
+         .raw("      }\n")
+         .raw("      var l = labels[f];\n")
+         .raw("      features[f] = {type:'Feature', id:ids[f], properties:{fips:l[0], name:l[1], state:l[2]},\n")
+         .raw("        geometry:{type:'MultiPolygon', coordinates:polygons}};\n")
+         .raw("    }\n")
+         .raw("    return {type:'FeatureCollection', features:features};\n")
+         .raw("  },\n")
+         .raw("  decode: function(topo) {\n")
+         .raw("    var s = topo.transform.scale, t = topo.transform.translate;\n")
+         .raw("    var arcs = topo.arcs.map(function(arc) {\n")
+         .raw("      var x = 0, y = 0;\n")
+         .raw("      return arc.map(function(p) { x += p[0]; y += p[1]; return [x * s[0] + t[0], y * s[1] + t[1]]; });\n")
+         .raw("    });\n")
+         .raw("    function ring(refs) {\n")
+         .raw("      var out = [];\n")
+         .raw("      for (var i = 0; i < refs.length; i++) {\n")
+         .raw("        var a = refs[i] < 0 ? arcs[~refs[i]].slice().reverse() : arcs[refs[i]];\n")
+         .raw("        for (var j = out.length ? 1 : 0; j < a.length; j++) { out.push(a[j]); }\n")
+         .raw("      }\n")
+         .raw("      return out;\n")
+         .raw("    }\n")
+         .raw("    return {type:'FeatureCollection', features:topo.objects.counties.geometries.map(function(g) {\n")
+         .raw("      return {type:'Feature', id:g.id, properties:g.properties,\n")
+         .raw("        geometry:{type:'MultiPolygon', coordinates:g.arcs.map(function(p) { return p.map(ring); })}};\n")
+         .raw("    })};\n")
+         .raw("  }\n")
+         .raw("};\n");
+
+      if (!raster)
       {
-        bool first = true;
-        for (size_t idx = 0; idx < counties->size(); ++idx)
-        {
-          const county_record& c = (*counties)[idx];
-          if (c.geojson.empty() || c.geojson == "null")
-          {
-            continue;
-          }
-
-          if (!first)
-          {
-            js << ",\n";
-          }
-          first = false;
-
-          std::string color = margin_to_color(c.margin);
-
-          js << "{type:'Feature',id:'" << c.fips << "',"
-             << "properties:{"
-             << "fips:'" << c.fips << "',"
-             << "name:'" << escape_js_string(c.name) << "',"
-             << "state:'" << escape_js_string(c.state_name) << "',"
-             << "gop:" << c.votes_gop << ","
-             << "dem:" << c.votes_dem << ","
-             << "total:" << c.votes_total << ","
-             << "per_gop:" << c.per_gop << ","
-             << "per_dem:" << c.per_dem << ","
-             << "margin:" << c.margin << ","
-             << "color:'" << color << "'"
-             << "},geometry:" << c.geojson << "}";
-        }
+        js.raw("window.us_elections.apply(").raw(attributes()).raw(");\n");
       }
 
-      js << "]};\n";
+      js.raw("window.map.on('load', function() {\n");
 
       /////////////////////////////////////////////////////////////////////////////////////////////////////
-      // add source and layers
+      // geometry is a cacheable HTTP resource shared by all sessions and years, either one
+      // GeoJSON or TopoJSON document or vector tiles; tiles are requested up to zoom 10 and
+      // overzoomed after. Raster tiles are rendered per year on the server and carry no features,
+      // so there is no hover or click
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "window.map.addSource('counties', {type:'geojson', data:geojson});\n";
+      if (raster)
+      {
+        js.raw("window.us_elections.tiles = window.location.origin + ").value(raster_url).raw(";\n");
+        js.raw("window.map.addSource('counties', {type:'raster', tiles:[window.us_elections.tiles], tileSize:256, maxzoom:10});\n");
+        js.raw("window.map.addLayer({id:'counties-raster', type:'raster', source:'counties', paint:{'raster-opacity':0.8}});\n");
+        js.raw("});\n");
+        WApplication::instance()->doJavaScript(js.take());
+        return;
+      }
+      else if (vector_tiles)
+      {
+        js.raw("window.map.addSource('counties', {type:'vector', tiles:[window.location.origin + ")
+           .value(tiles_url).raw("], maxzoom:10});\n");
+      }
+      else
+      {
+        std::string url;
+        if (!geometry_urls.empty())
+        {
+          url = geometry_urls[std::min(geometry_level, static_cast<int>(geometry_urls.size()) - 1)];
+        }
+        js.raw("window.map.addSource('counties', {type:'geojson', data:{type:'FeatureCollection', features:[]}});\n");
+        js.raw("window.us_elections.load(").value(url).raw(");\n");
+        js.raw("window.map.on('sourcedata', function(e) {\n")
+           .raw("  if (e.sourceId === 'counties' && e.isSourceLoaded) { window.us_elections.ready(); }\n")
+           .raw("});\n");
+        js.raw("window.map.on('zoomend', function() {\n")
+           .raw("  ").raw(zoom_changed.createCall({ "Math.floor(window.map.getZoom())" })).raw(";\n")
+           .raw("});\n");
+      }
+
+      js.raw("window.map.addLayer({\n")
+         .raw("  id:'counties-fill', type:'fill', source:'counties', ").raw(source_layer).raw("\n")
+         .raw("  paint:{'fill-color':['case',['==',['typeof',['feature-state','swing']],'number'],")
+         .raw(swing_color_expression("['feature-state','swing']")).raw(",")
+         .raw(margin_color_expression("['coalesce',['feature-state','margin'],0]")).raw("]")
+         .raw(", 'fill-opacity':0.8}\n")
+         .raw("});\n");
 
-      js << "window.map.addLayer({\n"
-         << "  id:'counties-fill', type:'fill', source:'counties',\n"
-         << "  paint:{'fill-color':['get','color'], 'fill-opacity':0.8}\n"
-         << "});\n";
+      js.raw("window.map.addLayer({\n")
+         .raw("  id:'counties-line', type:'line', source:'counties', ").raw(source_layer).raw("\n")
+         .raw("  paint:{'line-color':'#222', 'line-width':0.3}\n")
+         .raw("});\n");
 
-      js << "window.map.addLayer({\n"
-         << "  id:'counties-line', type:'line', source:'counties',\n"
-         << "  paint:{'line-color':'#222', 'line-width':0.3}\n"
-         << "});\n";
+      js.raw("window.us_elections.apply(window.us_elections.rows);\n");
 
       /////////////////////////////////////////////////////////////////////////////////////////////////////
       // popup on hover
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "var popup = new maplibregl.Popup({closeButton:false, closeOnClick:false});\n";
-
-      js << "window.map.on('mousemove', 'counties-fill', function(e) {\n"
-         << "  if (e.features.length > 0) {\n"
-         << "    window.map.getCanvas().style.cursor = 'pointer';\n"
-         << "    var p = e.features[0].properties;\n"
-         << "    var winner = (p.margin > 0) ? 'GOP' : 'DEM';\n"
-         << "    var marginPct = Math.abs(p.margin * 100).toFixed(1);\n"
-         << "    var html = '<div style=\"font-family:sans-serif;font-size:12px;\">'\n"
-         << "      + '<strong>' + p.name + ', ' + p.state + '</strong><br>'\n"
-         << "      + '<span style=\"color:#B82D35\">GOP: ' + (p.per_gop * 100).toFixed(1) + '%</span><br>'\n"
-         << "      + '<span style=\"color:#2A71AE\">DEM: ' + (p.per_dem * 100).toFixed(1) + '%</span><br>'\n"
-         << "      + 'Margin: ' + winner + ' +' + marginPct + '%<br>'\n"
-         << "      + 'Total votes: ' + p.total.toLocaleString()\n"
-         << "      + '</div>';\n"
-         << "    popup.setLngLat(e.lngLat).setHTML(html).addTo(window.map);\n"
-         << "  }\n"
-         << "});\n";
-
-      js << "window.map.on('mouseleave', 'counties-fill', function() {\n"
-         << "  window.map.getCanvas().style.cursor = '';\n"
-         << "  popup.remove();\n"
-         << "});\n";
+      js.raw("var popup = new maplibregl.Popup({closeButton:false, closeOnClick:false});\n");
+
+      js.raw("window.map.on('mousemove', 'counties-fill', function(e) {\n")
+         .raw("  if (e.features.length > 0) {\n")
+         .raw("    window.map.getCanvas().style.cursor = 'pointer';\n")
+         .raw("    var p = e.features[0].properties;\n")
+         .raw("    var s = e.features[0].state;\n")
+         .raw("    if (typeof s.swing === 'number') {\n")
+         .raw("      var pts = function(v) { return (v > 0 ? '+' : '') + (v * 100).toFixed(1); };\n")
+         .raw("      popup.setLngLat(e.lngLat).setHTML('<div style=\"font-family:sans-serif;font-size:12px;\">'\n")
+         .raw("        + '<strong>' + p.name + (p.state ? ', ' + p.state : '') + '</strong><br>'\n")
+         .raw("        + 'Swing: ' + (s.swing > 0 ? 'GOP' : 'DEM') + ' +' + Math.abs(s.swing * 100).toFixed(1) + ' pts<br>'\n")
+         .raw("        + '<span style=\"color:#B82D35\">GOP: ' + pts(s.gop_shift) + ' pts</span><br>'\n")
+         .raw("        + '<span style=\"color:#2A71AE\">DEM: ' + pts(s.dem_shift) + ' pts</span><br>'\n")
+         .raw("        + 'Turnout: ' + pts(s.turnout) + '% (' + (s.total_change > 0 ? '+' : '') + s.total_change.toLocaleString() + ')'\n")
+         .raw("        + '</div>').addTo(window.map);\n")
+         .raw("      return;\n")
+         .raw("    }\n")
+         .raw("    var margin = s.margin || 0;\n")
+         .raw("    var winner = (margin > 0) ? 'GOP' : 'DEM';\n")
+         .raw("    var marginPct = Math.abs(margin * 100).toFixed(1);\n")
+         .raw("    var html = '<div style=\"font-family:sans-serif;font-size:12px;\">'\n")
+         .raw("      + '<strong>' + p.name + (p.state ? ', ' + p.state : '') + '</strong><br>'\n")
+         .raw("      + '<span style=\"color:#B82D35\">GOP: ' + ((s.per_gop || 0) * 100).toFixed(1) + '%</span><br>'\n")
+         .raw("      + '<span style=\"color:#2A71AE\">DEM: ' + ((s.per_dem || 0) * 100).toFixed(1) + '%</span><br>'\n")
+         .raw("      + 'Margin: ' + winner + ' +' + marginPct + '%<br>'\n")
+         .raw("      + 'Total votes: ' + (s.total || 0).toLocaleString()\n")
+         .raw("      + '</div>';\n")
+         .raw("    popup.setLngLat(e.lngLat).setHTML(html).addTo(window.map);\n")
+         .raw("  }\n")
+         .raw("});\n");
+
+      js.raw("window.map.on('mouseleave', 'counties-fill', function() {\n")
+         .raw("  window.map.getCanvas().style.cursor = '';\n")
+         .raw("  popup.remove();\n")
+         .raw("});\n");
 
       /////////////////////////////////////////////////////////////////////////////////////////////////////
       // click to zoom
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "window.map.on('click', 'counties-fill', function(e) {\n"
-         << "  var bbox = turf.bbox(e.features[0]);\n"
-         << "  window.map.fitBounds(bbox, { padding: 100 });\n"
-         << "});\n";
+      js.raw("window.map.on('click', 'counties-fill', function(e) {\n")
+         .raw("  var bbox = turf.bbox(e.features[0]);\n")
+         .raw("  window.map.fitBounds(bbox, { padding: 100 });\n")
+         .raw("});\n");
 
       /////////////////////////////////////////////////////////////////////////////////////////////////////
       // close map.on('load')
       /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-      js << "});\n";
+      js.raw("});\n");
 
       WApplication* app = WApplication::instance();
-      app->doJavaScript(js.str());
+      app->doJavaScript(js.take());
     }
   }
 
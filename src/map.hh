@@ -4,10 +4,12 @@
 #include <Wt/WCompositeWidget.h>
 #include <Wt/WWebWidget.h>
 #include <Wt/WApplication.h>
+#include <Wt/WJavaScript.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
-#include "data.hh"
+#include "payload.hh"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 // WMapLibre
@@ -25,15 +27,28 @@ namespace Wt
 
     void set_year(int year);
     void set_view_mode(const std::string& mode);
+    void set_source_mode(const std::string& mode);
+    void refresh_geometry();
     void refresh_data();
+    void on_zoom(int zoom);
 
     int current_year;
-    std::string view_mode;
-    std::vector<county_record>* counties;
-    std::vector<state_record>* states;
+    std::string view_mode;  // "county", "state" or "swing"
+    std::string source_mode;  // "geojson", "topojson", "binary", "mvt" or "raster"
+    std::shared_ptr<const year_payload_t> payload;
+    std::shared_ptr<const blob_t> swing;  // swing rows of the current year pair, for the swing view
+    std::vector<std::string> geometry_urls;  // geometry document URL per simplification level
+    int geometry_level;
+    int zoom;  // last zoom reported by the client
+    std::string tiles_url;
+    std::string raster_url;  // current year's PNG tile template, for the raster source
+    std::string attributes_url;  // current year's attributes resource; empty sends them inline
 
   protected:
     Impl* impl;
+    JSignal<int> zoom_changed;
+    std::string geometry_format() const;
+    std::string_view attributes() const;
     virtual void render(WFlags<RenderFlag> flags) override;
   };
 }
@@ -0,0 +1,1258 @@
+#include "payload.hh"
+#include "topology.hh"
+#include "json.hh"
+#include "compress.hh"
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// content_hash
+// 64-bit FNV-1a as 16 hex digits; used for cache busting URLs and ETags, not for security
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string content_hash(const std::string& data)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t idx = 0; idx < data.size(); ++idx)
+  {
+    hash ^= static_cast<unsigned char>(data[idx]);
+    hash *= 1099511628211ULL;
+  }
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// compress_blob
+// gzip and zstd at their highest practical levels; paid once per payload at build time.
+// A variant that does not save space is dropped
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void compress_blob(blob_t& blob)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  blob.gzip = gzip_compress(blob.data);
+  if (blob.gzip.size() >= blob.data.size())
+  {
+    std::string().swap(blob.gzip);
+  }
+  blob.zstd = zstd_compress(blob.data);
+  if (blob.zstd.size() >= blob.data.size())
+  {
+    std::string().swap(blob.zstd);
+  }
+
+  std::cout << "  compressed " << blob.data.size() << " bytes: gzip " << blob.gzip.size()
+    << ", zstd " << blob.zstd.size() << ", "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// margin buckets
+// margin: positive = gop (red), negative = dem (blue); last entry is the fallback
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct margin_bucket
+{
+  double above;
+  const char* color;
+};
+
+static const margin_bucket margin_buckets[] =
+{
+  { 0.3334, "#B82D35" },    // strong gop
+  { 0.1667, "#E48268" },    // lean gop
+  { 0.0, "#FACCB4" },       // slight gop
+  { -0.1667, "#BFDCEB" },   // slight dem
+  { -0.3334, "#6BACD0" },   // lean dem
+  { 0.0, "#2A71AE" }        // strong dem
+};
+
+const size_t margin_bucket_count = sizeof(margin_buckets) / sizeof(margin_buckets[0]);
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// margin_to_bucket
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t margin_to_bucket(double margin)
+{
+  for (size_t idx = 0; idx + 1 < margin_bucket_count; idx++)
+  {
+    if (margin > margin_buckets[idx].above) return idx;
+  }
+  return margin_bucket_count - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// margin_bucket_color
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string margin_bucket_color(size_t bucket)
+{
+  if (bucket >= margin_bucket_count)
+  {
+    return "";
+  }
+  return margin_buckets[bucket].color;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// margin_to_color
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string margin_to_color(double margin)
+{
+  return margin_buckets[margin_to_bucket(margin)].color;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// margin_color_expression
+// MapLibre 'case' expression equivalent to margin_to_color, for a margin expression
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string margin_color_expression(const std::string& margin)
+{
+  json_writer_t js(256);
+  js.raw("['case'");
+  for (size_t idx = 0; idx + 1 < margin_bucket_count; idx++)
+  {
+    js.raw(",['>',").raw(margin).raw(",").value(margin_buckets[idx].above).raw("],");
+    js.value(margin_buckets[idx].color);
+  }
+  js.raw(",").value(margin_buckets[margin_bucket_count - 1].color).raw("]");
+  return js.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// swing buckets
+// margin shift between two years: positive = toward gop (red), negative = toward dem (blue), in
+// the margin palette; a shift is rarely above 10 points, so the buckets are narrower
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const margin_bucket swing_buckets[] =
+{
+  { 0.10, "#B82D35" },      // strong shift to gop
+  { 0.05, "#E48268" },
+  { 0.0, "#FACCB4" },
+  { -0.05, "#BFDCEB" },
+  { -0.10, "#6BACD0" },
+  { 0.0, "#2A71AE" }        // strong shift to dem
+};
+
+const size_t swing_bucket_count = sizeof(swing_buckets) / sizeof(swing_buckets[0]);
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// swing_color_expression
+// MapLibre 'case' expression over the swing buckets, for a margin shift expression
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string swing_color_expression(const std::string& shift)
+{
+  json_writer_t js(256);
+  js.raw("['case'");
+  for (size_t idx = 0; idx + 1 < swing_bucket_count; idx++)
+  {
+    js.raw(",['>',").raw(shift).raw(",").value(swing_buckets[idx].above).raw("],");
+    js.value(swing_buckets[idx].color);
+  }
+  js.raw(",").value(swing_buckets[swing_bucket_count - 1].color).raw("]");
+  return js.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_geometry_json
+// year independent FeatureCollection; numeric FIPS ids so attributes can be set as feature state.
+// Features are written as the county rows stream from the database, one chunk at a time
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_geometry_json(database_t& db, int year, int level)
+{
+  json_writer_t writer(4 * 1024 * 1024);
+  writer.begin_object();
+  writer.key("type").value("FeatureCollection");
+  writer.key("features").begin_array();
+
+  db.stream_counties(year, level, [&writer](const std::vector<county_record>& rows)
+  {
+    for (size_t idx = 0; idx < rows.size(); ++idx)
+    {
+      const county_record& c = rows[idx];
+      if (c.geojson.empty() || c.geojson == "null")
+      {
+        continue;
+      }
+
+      writer.begin_object();
+      writer.key("type").value("Feature");
+      writer.key("id").value(static_cast<int64_t>(std::strtol(c.fips.c_str(), nullptr, 10)));
+      writer.key("properties").begin_object();
+      writer.key("fips").value(c.fips);
+      writer.key("name").value(c.name);
+      writer.key("state").value(c.state_name);
+      writer.end_object();
+      writer.key("geometry").json(c.geojson);
+      writer.end_object();
+    }
+    return true;
+  });
+
+  writer.end_array();
+  writer.end_object();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_topojson
+// TopoJSON with one "counties" object; arcs are quantized and delta-encoded, geometries reference
+// arcs by index (~index reversed). Same ids and properties as make_geometry_json
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_topojson(const topology_t& topology, const std::vector<shape_t>& shapes)
+{
+  json_writer_t writer(count_arc_points(topology) * 12 + shapes.size() * 128);
+  writer.begin_object();
+  writer.key("type").value("Topology");
+  writer.key("transform").begin_object();
+  writer.key("scale").begin_array().value(topology.scale_x).value(topology.scale_y).end_array();
+  writer.key("translate").begin_array().value(topology.translate_x).value(topology.translate_y).end_array();
+  writer.end_object();
+
+  writer.key("objects").begin_object();
+  writer.key("counties").begin_object();
+  writer.key("type").value("GeometryCollection");
+  writer.key("geometries").begin_array();
+  for (size_t idx = 0; idx < shapes.size() && idx < topology.geometries.size(); ++idx)
+  {
+    const arc_geometry_t& geometry = topology.geometries[idx];
+    if (geometry.empty())
+    {
+      continue;
+    }
+
+    const shape_t& shape = shapes[idx];
+    writer.begin_object();
+    writer.key("type").value("MultiPolygon");
+    writer.key("id").value(static_cast<int64_t>(std::strtol(shape.fips.c_str(), nullptr, 10)));
+    writer.key("properties").begin_object();
+    writer.key("fips").value(shape.fips);
+    writer.key("name").value(shape.name);
+    writer.key("state").value(shape.state_name);
+    writer.end_object();
+    writer.key("arcs").begin_array();
+    for (size_t idx_polygon = 0; idx_polygon < geometry.size(); idx_polygon++)
+    {
+      writer.begin_array();
+      for (size_t idx_ring = 0; idx_ring < geometry[idx_polygon].size(); idx_ring++)
+      {
+        const arc_ring_t& ring = geometry[idx_polygon][idx_ring];
+        writer.begin_array();
+        for (size_t idx_arc = 0; idx_arc < ring.size(); idx_arc++)
+        {
+          writer.value(ring[idx_arc]);
+        }
+        writer.end_array();
+      }
+      writer.end_array();
+    }
+    writer.end_array();
+    writer.end_object();
+  }
+  writer.end_array();
+  writer.end_object();
+  writer.end_object();
+
+  writer.key("arcs").begin_array();
+  for (size_t idx_arc = 0; idx_arc < topology.arcs.size(); idx_arc++)
+  {
+    const arc_t& arc = topology.arcs[idx_arc];
+    writer.begin_array();
+    int32_t x = 0, y = 0;
+    for (size_t idx = 0; idx < arc.size(); idx++)
+    {
+      writer.begin_array().value(arc[idx].x - x).value(arc[idx].y - y).end_array();
+      x = arc[idx].x;
+      y = arc[idx].y;
+    }
+    writer.end_array();
+  }
+  writer.end_array();
+  writer.end_object();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_geometry_binary
+// "USEB" layout, little endian, every section 4-byte aligned so the client maps typed arrays
+// straight onto the buffer:
+//   char[4] magic, uint32 version, features, polygons, rings, points
+//   float64 scale_x, scale_y, translate_x, translate_y, uint32 labels_size
+//   int32 ids[features]
+//   uint32 feature_polygons[features + 1], polygon_rings[polygons + 1], ring_points[rings + 1]
+//   int32 coordinates[points * 2], degrees = value * scale + translate
+//   labels: JSON [[fips, name, state], ...], same order as ids
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void append_uint32(std::string& out, uint32_t value)
+{
+  for (int idx = 0; idx < 4; idx++)
+  {
+    out.push_back(static_cast<char>((value >> (8 * idx)) & 0xff));
+  }
+}
+
+static void append_double(std::string& out, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, 8);
+  for (int idx = 0; idx < 8; idx++)
+  {
+    out.push_back(static_cast<char>((bits >> (8 * idx)) & 0xff));
+  }
+}
+
+std::string make_geometry_binary(const std::vector<shape_t>& shapes, int decimals)
+{
+  size_t polygons = 0, rings = 0, points = 0;
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    const multipolygon_t& mp = shapes[idx].polygons;
+    polygons += mp.size();
+    for (size_t idx_polygon = 0; idx_polygon < mp.size(); idx_polygon++)
+    {
+      rings += mp[idx_polygon].size();
+    }
+    points += count_points(mp);
+  }
+
+  json_writer_t labels(shapes.size() * 48);
+  labels.begin_array();
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    labels.begin_array().value(shapes[idx].fips).value(shapes[idx].name).value(shapes[idx].state_name).end_array();
+  }
+  labels.end_array();
+  std::string label_json = labels.take();
+
+  double scale = std::pow(10.0, -decimals);
+  std::string out;
+  out.reserve(60 + 4 * (2 * shapes.size() + polygons + rings + 3) + 8 * points + label_json.size());
+  out.append("USEB", 4);
+  append_uint32(out, 1);
+  append_uint32(out, static_cast<uint32_t>(shapes.size()));
+  append_uint32(out, static_cast<uint32_t>(polygons));
+  append_uint32(out, static_cast<uint32_t>(rings));
+  append_uint32(out, static_cast<uint32_t>(points));
+  append_double(out, scale);
+  append_double(out, scale);
+  append_double(out, 0.0);
+  append_double(out, 0.0);
+  append_uint32(out, static_cast<uint32_t>(label_json.size()));
+
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    append_uint32(out, static_cast<uint32_t>(std::strtol(shapes[idx].fips.c_str(), nullptr, 10)));
+  }
+
+  uint32_t offset = 0;
+  append_uint32(out, 0);
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    offset += static_cast<uint32_t>(shapes[idx].polygons.size());
+    append_uint32(out, offset);
+  }
+
+  offset = 0;
+  append_uint32(out, 0);
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    const multipolygon_t& mp = shapes[idx].polygons;
+    for (size_t idx_polygon = 0; idx_polygon < mp.size(); idx_polygon++)
+    {
+      offset += static_cast<uint32_t>(mp[idx_polygon].size());
+      append_uint32(out, offset);
+    }
+  }
+
+  offset = 0;
+  append_uint32(out, 0);
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    const multipolygon_t& mp = shapes[idx].polygons;
+    for (size_t idx_polygon = 0; idx_polygon < mp.size(); idx_polygon++)
+    {
+      for (size_t idx_ring = 0; idx_ring < mp[idx_polygon].size(); idx_ring++)
+      {
+        offset += static_cast<uint32_t>(mp[idx_polygon][idx_ring].size());
+        append_uint32(out, offset);
+      }
+    }
+  }
+
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    const multipolygon_t& mp = shapes[idx].polygons;
+    for (size_t idx_polygon = 0; idx_polygon < mp.size(); idx_polygon++)
+    {
+      for (size_t idx_ring = 0; idx_ring < mp[idx_polygon].size(); idx_ring++)
+      {
+        const ring_t& ring = mp[idx_polygon][idx_ring];
+        for (size_t idx_point = 0; idx_point < ring.size(); idx_point++)
+        {
+          append_uint32(out, static_cast<uint32_t>(static_cast<int32_t>(std::lround(ring[idx_point].x / scale))));
+          append_uint32(out, static_cast<uint32_t>(static_cast<int32_t>(std::lround(ring[idx_point].y / scale))));
+        }
+      }
+    }
+  }
+
+  out.append(label_json);
+  return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_attributes_json
+// per-year numbers keyed by numeric FIPS; margin is per_gop - per_dem and derived on the client.
+// Shares are written with 6 decimals
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_attributes_row(json_writer_t& writer, const county_table_t& counties, size_t idx)
+{
+  writer.begin_array();
+  writer.value(static_cast<int64_t>(counties.id[idx]));
+  writer.value(counties.votes_gop[idx]);
+  writer.value(counties.votes_dem[idx]);
+  writer.value(counties.votes_total[idx]);
+  writer.fixed(counties.per_gop[idx]);
+  writer.fixed(counties.per_dem[idx]);
+  writer.end_array();
+}
+
+std::string make_attributes_json(const county_table_t& counties)
+{
+  json_writer_t writer(counties.size() * 64, 6);
+  writer.begin_array();
+  for (size_t idx = 0; idx < counties.size(); ++idx)
+  {
+    write_attributes_row(writer, counties, idx);
+  }
+  writer.end_array();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_attributes_json
+// the same rows for a subset of the counties, by row index
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_attributes_json(const county_table_t& counties, const std::vector<size_t>& rows)
+{
+  json_writer_t writer(rows.size() * 64, 6);
+  writer.begin_array();
+  for (size_t idx = 0; idx < rows.size(); ++idx)
+  {
+    write_attributes_row(writer, counties, rows[idx]);
+  }
+  writer.end_array();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_attributes_json
+// same rows per state, keyed by numeric state FIPS
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_attributes_json(const std::vector<state_record>& states)
+{
+  json_writer_t writer(states.size() * 64, 6);
+  writer.begin_array();
+  for (size_t idx = 0; idx < states.size(); ++idx)
+  {
+    const state_record& s = states[idx];
+    writer.begin_array();
+    writer.value(static_cast<int64_t>(std::strtol(s.fips.c_str(), nullptr, 10)));
+    writer.value(s.votes_gop);
+    writer.value(s.votes_dem);
+    writer.value(s.votes_total);
+    writer.fixed(s.per_gop);
+    writer.fixed(s.per_dem);
+    writer.end_array();
+  }
+  writer.end_array();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_swing_json
+// rows [fips, margin_shift, per_gop_shift, per_dem_shift, turnout_change, votes_total_change]
+// keyed by numeric FIPS, the same ids as the attributes; shifts with 6 decimals
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_swing_json(const std::vector<swing_record>& rows)
+{
+  json_writer_t writer(rows.size() * 64, 6);
+  writer.begin_array();
+  for (size_t idx = 0; idx < rows.size(); ++idx)
+  {
+    const swing_record& rec = rows[idx];
+    writer.begin_array();
+    writer.value(static_cast<int64_t>(std::strtoul(rec.fips.c_str(), nullptr, 10)));
+    writer.fixed(rec.margin_shift);
+    writer.fixed(rec.per_gop_shift);
+    writer.fixed(rec.per_dem_shift);
+    writer.fixed(rec.turnout_change);
+    writer.value(rec.votes_total_change);
+    writer.end_array();
+  }
+  writer.end_array();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_state_geometry_json
+// FeatureCollection of state boundaries, numeric state FIPS ids, at the given precision
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string make_state_geometry_json(const std::vector<shape_t>& shapes, const std::vector<multipolygon_t>& polygons, int decimals)
+{
+  size_t points = 0;
+  for (size_t idx = 0; idx < polygons.size(); idx++)
+  {
+    points += count_points(polygons[idx]);
+  }
+
+  json_writer_t writer(points * 24 + shapes.size() * 128, decimals);
+  writer.begin_object();
+  writer.key("type").value("FeatureCollection");
+  writer.key("features").begin_array();
+  for (size_t idx = 0; idx < shapes.size() && idx < polygons.size(); ++idx)
+  {
+    if (polygons[idx].empty())
+    {
+      continue;
+    }
+    const shape_t& shape = shapes[idx];
+    writer.begin_object();
+    writer.key("type").value("Feature");
+    writer.key("id").value(static_cast<int64_t>(std::strtol(shape.fips.c_str(), nullptr, 10)));
+    writer.key("properties").begin_object();
+    writer.key("fips").value(shape.fips);
+    writer.key("name").value(shape.name);
+    writer.end_object();
+    writer.key("geometry");
+    write_geojson_geometry(writer, polygons[idx]);
+    writer.end_object();
+  }
+  writer.end_array();
+  writer.end_object();
+  return writer.take();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_bytes
+// approximate heap size of a payload
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t payload_bytes(const year_payload_t& payload)
+{
+  size_t size = sizeof(year_payload_t) + payload.attributes.data.capacity() +
+    payload.attributes.gzip.capacity() + payload.attributes.zstd.capacity() +
+    payload.state_attributes.data.capacity() + payload.state_attributes.gzip.capacity() +
+    payload.state_attributes.zstd.capacity() + payload.counties.bytes() - sizeof(county_table_t);
+  for (size_t idx = 0; idx < payload.states.size(); idx++)
+  {
+    const state_record& s = payload.states[idx];
+    size += sizeof(state_record) + s.fips.capacity() + s.name.capacity() +
+      s.winner.capacity();
+  }
+  return size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_cache_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+payload_cache_t::payload_cache_t(database_t& db_) : db(&db_)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_cache_t
+// from a snapshot written by the loader: every year and geometry document is taken as stored,
+// no query, serialization or compression, and no database. A snapshot missing a year it lists,
+// a geometry level or the state geometry is damaged and throws std::runtime_error
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+payload_cache_t::payload_cache_t(std::shared_ptr<const snapshot_t> snapshot) : db(nullptr)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::string_view section = snapshot->section("years");
+  if (!get_array(section, years) || years.empty())
+  {
+    throw std::runtime_error("Snapshot has no years");
+  }
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    std::shared_ptr<const year_payload_t> payload = read_snapshot_payload(snapshot, years[idx]);
+    if (!payload)
+    {
+      throw std::runtime_error("Snapshot year " + std::to_string(years[idx]) + " is missing or damaged");
+    }
+    payloads[years[idx]] = payload;
+  }
+
+  for (int idx = 0; idx < geometry_level_count; idx++)
+  {
+    std::string level = std::to_string(geometry_levels[idx].level);
+    std::shared_ptr<const blob_t> blob_geometry = read_snapshot_blob(snapshot, "geometry/" + level);
+    std::shared_ptr<const blob_t> blob_topojson = read_snapshot_blob(snapshot, "topojson/" + level);
+    std::shared_ptr<const blob_t> blob_binary = read_snapshot_blob(snapshot, "binary/" + level);
+    if (!blob_geometry || !blob_topojson || !blob_binary)
+    {
+      throw std::runtime_error("Snapshot geometry level " + level + " is missing or damaged");
+    }
+    geometry[geometry_levels[idx].level] = blob_geometry;
+    topojson[geometry_levels[idx].level] = blob_topojson;
+    binary[geometry_levels[idx].level] = blob_binary;
+  }
+  state_geometry = read_snapshot_blob(snapshot, "state_geometry");
+  if (!state_geometry)
+  {
+    throw std::runtime_error("Snapshot state geometry is missing or damaged");
+  }
+
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    for (size_t idx_base = 0; idx_base < years.size(); idx_base++)
+    {
+      if (years[idx_base] >= years[idx])
+      {
+        continue;
+      }
+      std::shared_ptr<const blob_t> blob = read_snapshot_blob(snapshot,
+        "swing/" + std::to_string(years[idx]) + "/" + std::to_string(years[idx_base]));
+      if (blob) swing[std::make_pair(years[idx], years[idx_base])] = blob;
+    }
+  }
+
+  std::cout << "Snapshot: " << payloads.size() << " years, " << geometry.size() << " geometry levels, "
+    << snapshot->size() << " bytes mapped in "
+    << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+    << " us" << std::endl;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_all
+// warm the cache at startup so the first session of each year does not pay for the query. Swing
+// is warmed against the previous election, the default comparison; other pairs build on first use
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void payload_cache_t::build_all()
+{
+  std::vector<int> all_years = get_years();
+  for (size_t idx = 0; idx < all_years.size(); idx++)
+  {
+    get(all_years[idx]);
+  }
+  // years are newest first
+  for (size_t idx = 0; idx + 1 < all_years.size(); idx++)
+  {
+    get_swing(all_years[idx], all_years[idx + 1]);
+  }
+  for (int idx = 0; idx < geometry_level_count; idx++)
+  {
+    get_geometry(geometry_levels[idx].level);
+    get_topojson(geometry_levels[idx].level);
+    get_binary(geometry_levels[idx].level);
+  }
+  get_state_geometry();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_years
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<int> payload_cache_t::get_years()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (years.empty() && db)
+  {
+    years = db->get_years();
+  }
+  return years;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get
+// build on first use, outside the lock: reads check out their own pooled connection, so builds
+// of different years run in parallel. When two sessions build the same year, the first stored
+// wins, and a payload patched by apply_updates meanwhile is never replaced
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const year_payload_t> payload_cache_t::get(int year)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const year_payload_t>>::iterator it = payloads.find(year);
+    if (it != payloads.end())
+    {
+      return it->second;
+    }
+  }
+  if (!db)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const year_payload_t> payload = build(year);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return payloads.emplace(year, payload).first->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_attributes
+// the attributes blob of a year, sharing ownership with its payload; years without results
+// return null rather than building an empty payload
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_attributes(int year)
+{
+  std::vector<int> known = get_years();
+  if (std::find(known.begin(), known.end(), year) == known.end())
+  {
+    return nullptr;
+  }
+  std::shared_ptr<const year_payload_t> payload = get(year);
+  if (!payload)
+  {
+    return nullptr;
+  }
+  return std::shared_ptr<const blob_t>(payload, &payload->attributes);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_state_attributes
+// per-state rows of a year, as get_attributes
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_state_attributes(int year)
+{
+  std::vector<int> known = get_years();
+  if (std::find(known.begin(), known.end(), year) == known.end())
+  {
+    return nullptr;
+  }
+  std::shared_ptr<const year_payload_t> payload = get(year);
+  if (!payload)
+  {
+    return nullptr;
+  }
+  return std::shared_ptr<const blob_t>(payload, &payload->state_attributes);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_swing
+// county swing rows of year against an earlier base_year, precomputed by the loader in
+// county_swing and serialized once per pair; null unless both years have results and
+// base_year is the earlier
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_swing(int year, int base_year)
+{
+  std::vector<int> known = get_years();
+  if (base_year >= year || std::find(known.begin(), known.end(), year) == known.end() ||
+    std::find(known.begin(), known.end(), base_year) == known.end())
+  {
+    return nullptr;
+  }
+
+  std::pair<int, int> key(year, base_year);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::pair<int, int>, std::shared_ptr<const blob_t>>::iterator it = swing.find(key);
+    if (it != swing.end())
+    {
+      return it->second;
+    }
+  }
+  if (!db)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const blob_t> blob = build_swing(year, base_year);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return swing.emplace(key, blob).first->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_swing
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::build_swing(int year, int base_year)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<swing_record> rows = db->get_swing(year, base_year);
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = make_swing_json(rows);
+  blob->hash = content_hash(blob->data);
+  blob->mime = "application/json";
+
+  std::cout << "Swing " << year << " from " << base_year << ": " << rows.size() << " counties, "
+    << blob->data.size() << " bytes in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+
+  compress_blob(*blob);
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// apply_updates
+// live results for one year: written to the database, then patched into a copy of the cached
+// payload (county rows, attribute blobs) without re-running the county query; state and national
+// rows are re-read from the refreshed aggregate tables. The cached swing of pairs with the year,
+// rebuilt in the database by update_results, is serialized again here once for all sessions.
+// The write, serialization and compression run outside the cache lock, which is taken only to
+// swap in the new payload, so sessions and resource requests are not held up by a tick.
+// Sessions holding the previous payload keep it until they switch
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const year_payload_t> payload_cache_t::apply_updates(int year, const std::vector<result_update>& updates)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> update_lock(update_mutex);
+
+  if (!db || db->update_results(updates) < 0)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const year_payload_t> cached;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const year_payload_t>>::iterator it = payloads.find(year);
+    if (it != payloads.end())
+    {
+      cached = it->second;
+    }
+  }
+
+  std::shared_ptr<const year_payload_t> result;
+  if (!cached)
+  {
+    result = build(year);
+  }
+  else
+  {
+    std::shared_ptr<year_payload_t> payload = std::make_shared<year_payload_t>(*cached);
+    std::unordered_map<uint32_t, size_t> index;
+    for (size_t idx = 0; idx < payload->counties.size(); idx++)
+    {
+      index[payload->counties.id[idx]] = idx;
+    }
+    for (size_t idx = 0; idx < updates.size(); idx++)
+    {
+      const result_update& u = updates[idx];
+      std::unordered_map<uint32_t, size_t>::iterator it_county = index.find(static_cast<uint32_t>(std::strtoul(u.fips.c_str(), nullptr, 10)));
+      if (it_county == index.end())
+      {
+        continue;
+      }
+      payload->counties.set_votes(it_county->second, u.votes_gop, u.votes_dem, u.votes_total);
+    }
+
+    // update_results refreshed the year's aggregates; read them instead of summing the counties
+    payload->states = db->get_states(year);
+    payload->national = db->get_national(year);
+
+    payload->attributes = blob_t();
+    payload->attributes.data = make_attributes_json(payload->counties);
+    payload->attributes.hash = content_hash(payload->attributes.data);
+    payload->attributes.mime = "application/json";
+    payload->state_attributes = blob_t();
+    payload->state_attributes.data = make_attributes_json(payload->states);
+    payload->state_attributes.hash = content_hash(payload->state_attributes.data);
+    payload->state_attributes.mime = "application/json";
+    compress_blob(payload->attributes);
+    compress_blob(payload->state_attributes);
+    result = payload;
+  }
+
+  std::vector<std::pair<int, int>> pairs;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::map<std::pair<int, int>, std::shared_ptr<const blob_t>>::const_iterator it_swing = swing.begin(); it_swing != swing.end(); ++it_swing)
+    {
+      if (it_swing->first.first == year || it_swing->first.second == year)
+      {
+        pairs.push_back(it_swing->first);
+      }
+    }
+  }
+  std::vector<std::shared_ptr<const blob_t>> swing_blobs;
+  for (size_t idx = 0; idx < pairs.size(); idx++)
+  {
+    swing_blobs.push_back(build_swing(pairs[idx].first, pairs[idx].second));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!cached)
+    {
+      years.clear();
+    }
+    payloads[year] = result;
+    for (size_t idx = 0; idx < pairs.size(); idx++)
+    {
+      swing[pairs[idx]] = swing_blobs[idx];
+    }
+  }
+
+  std::cout << "Payload " << year << ": " << updates.size() << " live updates applied in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+
+  return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const year_payload_t> payload_cache_t::build(int year)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::shared_ptr<year_payload_t> payload = std::make_shared<year_payload_t>();
+  payload->year = year;
+  payload->counties = db->get_counties(year);
+  payload->states = db->get_states(year);
+  payload->national = db->get_national(year);
+
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+
+  // geometry is served once by get_geometry, not per year
+  payload->counties.release_geometry();
+  payload->attributes.data = make_attributes_json(payload->counties);
+  payload->attributes.hash = content_hash(payload->attributes.data);
+  payload->attributes.mime = "application/json";
+  payload->state_attributes.data = make_attributes_json(payload->states);
+  payload->state_attributes.hash = content_hash(payload->state_attributes.data);
+  payload->state_attributes.mime = "application/json";
+
+  std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+
+  std::cout << "Payload " << year << ": "
+    << payload->counties.size() << " counties, "
+    << payload->attributes.data.size() << " bytes attributes, "
+    << payload_bytes(*payload) << " bytes resident, query "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(queried - start).count() << " ms, serialize "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(built - queried).count() << " ms ("
+    << megabytes_per_second(payload->attributes.data.size(), built - queried) << " MB/s)" << std::endl;
+
+  compress_blob(payload->attributes);
+  compress_blob(payload->state_attributes);
+
+  return payload;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_geometry
+// unknown levels return null. Like get, the geometry documents build outside the lock, so a
+// cold level does not hold up other sessions; the first stored wins
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_geometry(int level)
+{
+  if (level < 0 || level >= geometry_level_count)
+  {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const blob_t>>::iterator it = geometry.find(level);
+    if (it != geometry.end())
+    {
+      return it->second;
+    }
+  }
+  if (!db)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const blob_t> blob = build_geometry(level);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return geometry.emplace(level, blob).first->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// cached_geometry
+// the GeoJSON of a level if already built, never building it; for size reports
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::cached_geometry(int level)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<int, std::shared_ptr<const blob_t>>::iterator it = geometry.find(level);
+  return (it != geometry.end()) ? it->second : nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_geometry
+// names come from the most recent year with results; the topojson has none
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::build_geometry(int level)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<int> all_years = get_years();
+  int year = all_years.empty() ? 0 : all_years[0];
+
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = make_geometry_json(*db, year, level);
+  blob->hash = content_hash(blob->data);
+  blob->mime = "application/json";
+
+  std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+
+  std::cout << "Geometry level " << level << ": " << blob->data.size() << " bytes, hash " << blob->hash << ", streamed in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(built - start).count() << " ms ("
+    << megabytes_per_second(blob->data.size(), built - start) << " MB/s)" << std::endl;
+
+  compress_blob(*blob);
+
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_state_geometry
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_state_geometry()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (state_geometry || !db)
+    {
+      return state_geometry;
+    }
+  }
+
+  std::shared_ptr<const blob_t> blob = build_state_geometry();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!state_geometry)
+  {
+    state_geometry = blob;
+  }
+  return state_geometry;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_state_geometry
+// one document for all zooms: state outlines go through the shared-arc simplification of
+// level 1, so neighbouring states keep identical borders and a national view stays small
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::build_state_geometry()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  const geometry_level& level = geometry_levels[geometry_level_count > 1 ? 1 : 0];
+  std::vector<shape_t> shapes = db->get_state_shapes();
+  topology_t simplified = simplify_topology(build_topology(shapes, 10000000), level.tolerance);
+  std::vector<multipolygon_t> polygons;
+  size_t points = 0;
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    polygons.push_back(topology_polygons(simplified, idx, level.decimals));
+    if (polygons.back().empty())
+    {
+      polygons.back() = shapes[idx].polygons;
+    }
+    points += count_points(polygons.back());
+  }
+
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = make_state_geometry_json(shapes, polygons, level.decimals);
+  blob->hash = content_hash(blob->data);
+  blob->mime = "application/json";
+
+  std::cout << "State geometry: " << shapes.size() << " states, " << points << " points, "
+    << blob->data.size() << " bytes, hash " << blob->hash << ", "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+
+  compress_blob(*blob);
+
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_topojson
+// unknown levels return null
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_topojson(int level)
+{
+  if (level < 0 || level >= geometry_level_count)
+  {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const blob_t>>::iterator it = topojson.find(level);
+    if (it != topojson.end())
+    {
+      return it->second;
+    }
+  }
+  if (!db)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const blob_t> blob = build_topojson(level);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return topojson.emplace(level, blob).first->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_topojson
+// the topology is built once from the source geometry at 1e5 quantization, as in us-atlas;
+// levels above 0 simplify its arcs. Size is reported against the GeoJSON of the same level
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::build_topojson(int level)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> topology_lock(topology_mutex);
+  if (!topology)
+  {
+    topology_shapes = db->get_shapes();
+    topology = std::make_unique<topology_t>(build_topology(topology_shapes, 100000));
+    for (size_t idx = 0; idx < topology_shapes.size(); idx++)
+    {
+      multipolygon_t().swap(topology_shapes[idx].polygons);
+    }
+  }
+
+  topology_t simplified;
+  const topology_t* source = topology.get();
+  if (geometry_levels[level].tolerance > 0)
+  {
+    simplified = simplify_topology(*topology, geometry_levels[level].tolerance);
+    source = &simplified;
+  }
+
+  std::chrono::steady_clock::time_point serialize = std::chrono::steady_clock::now();
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = make_topojson(*source, topology_shapes);
+  std::chrono::steady_clock::duration serialized = std::chrono::steady_clock::now() - serialize;
+  blob->hash = content_hash(blob->data);
+  blob->mime = "application/json";
+
+  std::cout << "TopoJSON level " << level << ": " << blob->data.size() << " bytes, hash " << blob->hash;
+  std::shared_ptr<const blob_t> geojson = cached_geometry(level);
+  if (geojson && !geojson->body().empty())
+  {
+    std::cout << ", " << std::fixed << std::setprecision(1)
+      << 100.0 * blob->data.size() / geojson->body().size() << "% of GeoJSON ("
+      << geojson->body().size() << " bytes)" << std::defaultfloat;
+  }
+  std::cout << ", "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms, serialize " << megabytes_per_second(blob->data.size(), serialized) << " MB/s" << std::endl;
+
+  compress_blob(*blob);
+
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_binary
+// unknown levels return null
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::get_binary(int level)
+{
+  if (level < 0 || level >= geometry_level_count)
+  {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const blob_t>>::iterator it = binary.find(level);
+    if (it != binary.end())
+    {
+      return it->second;
+    }
+  }
+  if (!db)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const blob_t> blob = build_binary(level);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return binary.emplace(level, blob).first->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_binary
+// encoded from the stored WKB, no GeoJSON text involved; quantized to the level's decimals.
+// Encode time and size are reported against the GeoJSON of the same level
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> payload_cache_t::build_binary(int level)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<shape_t> shapes = db->get_shapes(level);
+  std::chrono::steady_clock::time_point queried = std::chrono::steady_clock::now();
+
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = make_geometry_binary(shapes, geometry_levels[level].decimals);
+  blob->hash = content_hash(blob->data);
+  blob->mime = "application/octet-stream";
+
+  std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+
+  std::cout << "Binary level " << level << ": " << blob->data.size() << " bytes, hash " << blob->hash << ", query "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(queried - start).count() << " ms, encode "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(built - queried).count() << " ms";
+  std::shared_ptr<const blob_t> geojson = cached_geometry(level);
+  if (geojson && !geojson->body().empty())
+  {
+    std::cout << ", " << std::fixed << std::setprecision(1)
+      << 100.0 * blob->data.size() / geojson->body().size() << "% of GeoJSON" << std::defaultfloat;
+  }
+  std::cout << std::endl;
+
+  compress_blob(*blob);
+  return blob;
+}
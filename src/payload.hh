@@ -0,0 +1,123 @@
+#ifndef ELECTIONS_PAYLOAD_HH
+#define ELECTIONS_PAYLOAD_HH
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "data.hh"
+#include "topology.hh"
+#include "snapshot.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// blob_t
+// immutable serialized payload served over HTTP; hash is used in the URL and as ETag.
+// Compressed variants are built once so requests never compress. A blob read from a snapshot
+// keeps its bodies in the mapped file: owner holds the mapping and the mapped_ views replace
+// the strings, so readers go through body(), gzip_body() and zstd_body()
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct blob_t
+{
+  std::string data;
+  std::string hash;
+  std::string mime;
+  std::string gzip;  // pre-compressed variants of data, empty when not built or not smaller
+  std::string zstd;
+  std::shared_ptr<const void> owner;
+  std::string_view mapped_data;
+  std::string_view mapped_gzip;
+  std::string_view mapped_zstd;
+
+  std::string_view body() const { return owner ? mapped_data : std::string_view(data); }
+  std::string_view gzip_body() const { return owner ? mapped_gzip : std::string_view(gzip); }
+  std::string_view zstd_body() const { return owner ? mapped_zstd : std::string_view(zstd); }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// year_payload_t
+// per-year data shared read-only by all sessions; built once by payload_cache_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct year_payload_t
+{
+  int year = 0;
+  county_table_t counties;  // geometry released, it is year independent
+  std::vector<state_record> states;
+  national_record national;
+  blob_t attributes;  // JSON rows [fips, gop, dem, total, per_gop, per_dem]
+  blob_t state_attributes;  // same rows per state
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_cache_t
+// process-wide cache of year_payload_t, one entry per election year, plus the county geometry
+// at each simplification level, as GeoJSON and as TopoJSON, the state boundaries and the county
+// swing rows of year pairs.
+// Built from the database, or filled from a snapshot at construction; a snapshot cache has no
+// database, takes no live updates, and entries missing from the snapshot return null
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class payload_cache_t
+{
+public:
+  payload_cache_t(database_t& db);
+  explicit payload_cache_t(std::shared_ptr<const snapshot_t> snapshot);
+
+  void build_all();
+  std::vector<int> get_years();
+  std::shared_ptr<const year_payload_t> get(int year);
+  std::shared_ptr<const year_payload_t> apply_updates(int year, const std::vector<result_update>& updates);
+  std::shared_ptr<const blob_t> get_attributes(int year);
+  std::shared_ptr<const blob_t> get_state_attributes(int year);
+  std::shared_ptr<const blob_t> get_swing(int year, int base_year);
+  std::shared_ptr<const blob_t> get_state_geometry();
+  std::shared_ptr<const blob_t> get_geometry(int level = 0);
+  std::shared_ptr<const blob_t> get_topojson(int level = 0);
+  std::shared_ptr<const blob_t> get_binary(int level = 0);
+
+private:
+  database_t* db;  // null when serving a snapshot
+  std::mutex mutex;
+  std::mutex update_mutex;  // one apply_updates at a time, held without the cache lock
+  std::vector<int> years;
+  std::map<int, std::shared_ptr<const year_payload_t>> payloads;
+  std::map<int, std::shared_ptr<const blob_t>> geometry;
+  std::map<int, std::shared_ptr<const blob_t>> topojson;
+  std::map<int, std::shared_ptr<const blob_t>> binary;
+  std::map<std::pair<int, int>, std::shared_ptr<const blob_t>> swing;  // by (year, base_year)
+  std::shared_ptr<const blob_t> state_geometry;
+  std::mutex topology_mutex;  // guards topology and topology_shapes while a level builds
+  std::unique_ptr<topology_t> topology;  // quantized arcs shared by all TopoJSON levels
+  std::vector<shape_t> topology_shapes;  // names only, polygons released after the build
+
+  std::shared_ptr<const year_payload_t> build(int year);
+  std::shared_ptr<const blob_t> build_swing(int year, int base_year);
+  std::shared_ptr<const blob_t> cached_geometry(int level);
+  std::shared_ptr<const blob_t> build_geometry(int level);
+  std::shared_ptr<const blob_t> build_topojson(int level);
+  std::shared_ptr<const blob_t> build_binary(int level);
+  std::shared_ptr<const blob_t> build_state_geometry();
+};
+
+std::string content_hash(const std::string& data);
+void compress_blob(blob_t& blob);
+extern const size_t margin_bucket_count;
+size_t margin_to_bucket(double margin);
+std::string margin_bucket_color(size_t bucket);
+std::string margin_to_color(double margin);
+std::string margin_color_expression(const std::string& margin);
+std::string swing_color_expression(const std::string& shift);
+std::string make_geometry_json(database_t& db, int year, int level);
+std::string make_topojson(const topology_t& topology, const std::vector<shape_t>& shapes);
+std::string make_geometry_binary(const std::vector<shape_t>& shapes, int decimals);
+std::string make_state_geometry_json(const std::vector<shape_t>& shapes, const std::vector<multipolygon_t>& polygons, int decimals);
+std::string make_attributes_json(const county_table_t& counties);
+std::string make_attributes_json(const county_table_t& counties, const std::vector<size_t>& rows);
+std::string make_attributes_json(const std::vector<state_record>& states);
+std::string make_swing_json(const std::vector<swing_record>& rows);
+size_t payload_bytes(const year_payload_t& payload);
+
+#endif
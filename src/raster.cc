@@ -0,0 +1,562 @@
+#include "raster.hh"
+#include "compress.hh"
+#include "topology.hh"
+#include <cmath>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// palette
+// index 0 is transparent (no county), then one entry per margin bucket, then the border color
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const uint32_t border_color = 0x222222;
+
+static std::vector<uint32_t> make_palette()
+{
+  std::vector<uint32_t> palette;
+  palette.push_back(0);
+  for (size_t idx = 0; idx < margin_bucket_count; idx++)
+  {
+    std::string color = margin_bucket_color(idx);
+    palette.push_back(static_cast<uint32_t>(std::strtoul(color.c_str() + 1, nullptr, 16)));
+  }
+  palette.push_back(border_color);
+  return palette;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// png chunks
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void append_uint32_be(std::string& out, uint32_t value)
+{
+  out.push_back(static_cast<char>((value >> 24) & 0xff));
+  out.push_back(static_cast<char>((value >> 16) & 0xff));
+  out.push_back(static_cast<char>((value >> 8) & 0xff));
+  out.push_back(static_cast<char>(value & 0xff));
+}
+
+static void append_chunk(std::string& out, const char* type, const std::string& data)
+{
+  append_uint32_be(out, static_cast<uint32_t>(data.size()));
+  size_t start = out.size();
+  out.append(type, 4);
+  out.append(data);
+  unsigned long crc = crc32_update(0, out.data() + start, out.size() - start);
+  append_uint32_be(out, static_cast<uint32_t>(crc));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// png_encode_indexed
+// 8-bit palette PNG, palette entries are 0xRRGGBB; index 0 is fully transparent.
+// Rows use filter type 0, long runs of one index deflate well without a filter search
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string png_encode_indexed(int width, int height, const std::vector<uint32_t>& palette, const std::vector<uint8_t>& pixels)
+{
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  std::string out(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+  std::string header;
+  append_uint32_be(header, static_cast<uint32_t>(width));
+  append_uint32_be(header, static_cast<uint32_t>(height));
+  header.push_back(8);  // bit depth
+  header.push_back(3);  // color type: palette
+  header.push_back(0);  // compression
+  header.push_back(0);  // filter
+  header.push_back(0);  // interlace
+  append_chunk(out, "IHDR", header);
+
+  std::string plte;
+  for (size_t idx = 0; idx < palette.size(); idx++)
+  {
+    plte.push_back(static_cast<char>((palette[idx] >> 16) & 0xff));
+    plte.push_back(static_cast<char>((palette[idx] >> 8) & 0xff));
+    plte.push_back(static_cast<char>(palette[idx] & 0xff));
+  }
+  append_chunk(out, "PLTE", plte);
+  append_chunk(out, "tRNS", std::string(1, '\0'));
+
+  std::string scanlines;
+  scanlines.reserve(static_cast<size_t>(height) * (width + 1));
+  for (int row = 0; row < height; row++)
+  {
+    scanlines.push_back(0);
+    scanlines.append(reinterpret_cast<const char*>(&pixels[static_cast<size_t>(row) * width]), width);
+  }
+  append_chunk(out, "IDAT", zlib_compress(scanlines));
+  append_chunk(out, "IEND", std::string());
+  return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_raster_path
+// "/<year>/z/x/y.png", as in the path info of /raster/2024/4/3/6.png
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool parse_raster_path(const std::string& path, int& year, int& z, int& x, int& y)
+{
+  if (path.size() < 2 || path[0] != '/')
+  {
+    return false;
+  }
+  size_t pos = path.find('/', 1);
+  if (pos == std::string::npos || pos == 1 || pos > 5)
+  {
+    return false;
+  }
+  for (size_t idx = 1; idx < pos; idx++)
+  {
+    if (path[idx] < '0' || path[idx] > '9') return false;
+  }
+  year = std::atoi(path.substr(1, pos - 1).c_str());
+  return parse_tile_path(path.substr(pos), ".png", z, x, y);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// process_id
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int process_id()
+{
+#ifdef _WIN32
+  return _getpid();
+#else
+  return static_cast<int>(getpid());
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// raster_key
+// tile_key leaves bits 44 to 57 unused for x below 2^15, the year goes there
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t raster_key(int year, int z, int x, int y)
+{
+  return tile_key(z, x, y) | (static_cast<uint64_t>(year & 0x3fff) << 44);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// raster_source_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+raster_source_t::raster_source_t(payload_cache_t& cache_, const std::vector<std::vector<shape_t>>& shapes,
+  const std::string& geometry_version_, const std::string& directory_, size_t capacity)
+  : cache(cache_), geometry_version(geometry_version_), directory(directory_), memory(capacity)
+{
+  for (size_t idx_level = 0; idx_level < shapes.size(); idx_level++)
+  {
+    std::vector<feature_t> features;
+    for (size_t idx_shape = 0; idx_shape < shapes[idx_level].size(); idx_shape++)
+    {
+      const shape_t& shape = shapes[idx_level][idx_shape];
+      feature_t feature;
+      feature.id = std::strtoull(shape.fips.c_str(), nullptr, 10);
+      feature.mercator = shape.polygons;
+      for (size_t idx_polygon = 0; idx_polygon < feature.mercator.size(); idx_polygon++)
+      {
+        polygon_t& polygon = feature.mercator[idx_polygon];
+        for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+        {
+          ring_t& ring = polygon[idx_ring];
+          for (size_t idx = 0; idx < ring.size(); idx++)
+          {
+            ring[idx] = to_mercator(ring[idx]);
+          }
+        }
+        feature.bboxes.push_back(bounding_box(polygon));
+      }
+      features.push_back(std::move(feature));
+    }
+    levels.push_back(std::move(features));
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_colors
+// palette index per county for a year, built on first use
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const raster_source_t::colors_t> raster_source_t::get_colors(int year)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, std::shared_ptr<const colors_t>>::const_iterator it = colors.find(year);
+    if (it != colors.end())
+    {
+      return it->second;
+    }
+  }
+
+  std::shared_ptr<const year_payload_t> payload = cache.get(year);
+  if (!payload)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<colors_t> table = std::make_shared<colors_t>();
+  table->version = content_hash(geometry_version + payload->attributes.hash);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    table->live = live_years.count(year) > 0;
+  }
+  const county_table_t& counties = payload->counties;
+  for (size_t idx = 0; idx < counties.size(); idx++)
+  {
+    table->index[counties.id[idx]] = static_cast<uint8_t>(1 + margin_to_bucket(counties.margin[idx]));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  colors[year] = table;
+  return table;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// version
+// tile URL version for a year; empty when the year has no results
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string raster_source_t::version(int year)
+{
+  std::shared_ptr<const colors_t> table = get_colors(year);
+  return table ? table->version : std::string();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// invalidate
+// after live updates: colors are rebuilt from the new payload, which changes the version;
+// cached tiles of the old version are no longer served. Versions after a live update change
+// every tick and stay in memory only, so they leave no directories behind on disk
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void raster_source_t::invalidate(int year)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  colors.erase(year);
+  live_years.insert(year);
+}
+
+std::string raster_source_t::tile_path(const std::string& version, int z, int x, int y) const
+{
+  return directory + "/" + version + "/" + std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y) + ".png";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get
+// memory cache of the current version, then disk cache, then render; thread safe, concurrent misses on the same tile may
+// both render. Disk writes go through a temporary file so readers never see a partial tile.
+// Years changed by live updates skip the disk cache
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> raster_source_t::get(int year, int z, int x, int y)
+{
+  if (z < 0 || z > max_zoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z))
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<const colors_t> table = get_colors(year);
+  if (!table)
+  {
+    return nullptr;
+  }
+
+  uint64_t key = raster_key(year, z, x, y);
+  std::shared_ptr<const blob_t> blob = memory.get(key);
+  if (blob && blob->hash == table->version)
+  {
+    return blob;
+  }
+
+  std::shared_ptr<blob_t> tile = std::make_shared<blob_t>();
+  tile->hash = table->version;
+  tile->mime = "image/png";
+
+  bool disk = !directory.empty() && !table->live;
+  std::string path = tile_path(table->version, z, x, y);
+  if (disk)
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (in.is_open())
+    {
+      std::stringstream ss;
+      ss << in.rdbuf();
+      tile->data = ss.str();
+    }
+  }
+
+  if (tile->data.empty())
+  {
+    tile->data = render(year, z, x, y);
+    if (disk)
+    {
+      std::error_code ec;
+      std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+      std::stringstream tmp;
+      // unique across threads and across server processes sharing the directory
+      tmp << path << ".tmp." << process_id() << "." << std::this_thread::get_id();
+      std::ofstream out(tmp.str(), std::ios::binary);
+      if (out.is_open())
+      {
+        out.write(tile->data.data(), static_cast<std::streamsize>(tile->data.size()));
+        out.close();
+        std::filesystem::rename(tmp.str(), path, ec);
+      }
+      if (ec)
+      {
+        std::cerr << "Raster: cannot write " << path << ": " << ec.message() << std::endl;
+      }
+    }
+  }
+
+  memory.put(key, tile);
+  return tile;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// render
+// even-odd scanline fill per polygon: each edge adds its crossing with the pixel-center line of
+// every row it spans, crossings are sorted and filled in pairs, so holes come out unfilled.
+// The owner of each pixel is kept to draw borders where neighbouring pixels differ. The fill
+// runs one pixel past the right and lower tile edges, so a border on a tile seam is drawn once,
+// by the tile left of or above it
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string raster_source_t::render(int year, int z, int x, int y)
+{
+  static const std::vector<uint32_t> palette = make_palette();
+  const uint8_t border_index = static_cast<uint8_t>(palette.size() - 1);
+  const int size = tile_size;
+
+  std::vector<uint8_t> pixels(static_cast<size_t>(size) * size, 0);
+  std::shared_ptr<const colors_t> table = get_colors(year);
+  if (!table || levels.empty())
+  {
+    return png_encode_indexed(size, size, palette, pixels);
+  }
+
+  int level = level_for_zoom(z);
+  size_t idx_level = 0;
+  for (int idx = 0; idx < geometry_level_count; idx++)
+  {
+    if (geometry_levels[idx].level == level) idx_level = static_cast<size_t>(idx);
+  }
+  if (idx_level >= levels.size())
+  {
+    idx_level = levels.size() - 1;
+  }
+  const std::vector<feature_t>& features = levels[idx_level];
+
+  double scale = static_cast<double>(1 << z);
+  double pixel_scale = scale * size;
+  BoundingBox tile_bbox(x / scale, y / scale, (x + 1) / scale + 1 / pixel_scale, (y + 1) / scale + 1 / pixel_scale);
+
+  // tile plus a one pixel gutter on the right and below
+  const int span = size + 1;
+  std::vector<uint8_t> fill(static_cast<size_t>(span) * span, 0);
+  std::vector<int32_t> owner(static_cast<size_t>(span) * span, -1);
+  std::vector<std::vector<double>> crossings(span);
+
+  for (size_t idx_feature = 0; idx_feature < features.size(); idx_feature++)
+  {
+    const feature_t& feature = features[idx_feature];
+    std::unordered_map<uint64_t, uint8_t>::const_iterator it_color = table->index.find(feature.id);
+    if (it_color == table->index.end())
+    {
+      continue;
+    }
+    uint8_t color = it_color->second;
+
+    for (size_t idx_polygon = 0; idx_polygon < feature.mercator.size(); idx_polygon++)
+    {
+      const BoundingBox& b = feature.bboxes[idx_polygon];
+      if (b.max_x < tile_bbox.min_x || b.min_x > tile_bbox.max_x || b.max_y < tile_bbox.min_y || b.min_y > tile_bbox.max_y)
+      {
+        continue;
+      }
+
+      int row_min = span;
+      int row_max = -1;
+      const polygon_t& polygon = feature.mercator[idx_polygon];
+      for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+      {
+        const ring_t& ring = polygon[idx_ring];
+        for (size_t idx = 0; idx + 1 < ring.size(); idx++)
+        {
+          double ax = ring[idx].x * pixel_scale - x * size;
+          double ay = ring[idx].y * pixel_scale - y * size;
+          double bx = ring[idx + 1].x * pixel_scale - x * size;
+          double by = ring[idx + 1].y * pixel_scale - y * size;
+          if (ay == by)
+          {
+            continue;
+          }
+          double y0 = std::min(ay, by);
+          double y1 = std::max(ay, by);
+          int r0 = std::max(0, static_cast<int>(std::ceil(y0 - 0.5)));
+          int r1 = std::min(span - 1, static_cast<int>(std::ceil(y1 - 0.5)) - 1);
+          double slope = (bx - ax) / (by - ay);
+          for (int row = r0; row <= r1; row++)
+          {
+            crossings[row].push_back(ax + (row + 0.5 - ay) * slope);
+          }
+          if (r0 <= r1)
+          {
+            row_min = std::min(row_min, r0);
+            row_max = std::max(row_max, r1);
+          }
+        }
+      }
+
+      for (int row = row_min; row <= row_max; row++)
+      {
+        std::vector<double>& xs = crossings[row];
+        std::sort(xs.begin(), xs.end());
+        for (size_t idx = 0; idx + 1 < xs.size(); idx += 2)
+        {
+          int c0 = std::max(0, static_cast<int>(std::ceil(xs[idx] - 0.5)));
+          int c1 = std::min(span - 1, static_cast<int>(std::ceil(xs[idx + 1] - 0.5)) - 1);
+          size_t offset = static_cast<size_t>(row) * span;
+          for (int col = c0; col <= c1; col++)
+          {
+            fill[offset + col] = color;
+            owner[offset + col] = static_cast<int32_t>(idx_feature);
+          }
+        }
+        xs.clear();
+      }
+    }
+  }
+
+  // borders: a pixel takes the border color where its right or lower neighbour has another owner;
+  // the neighbours of the last column and row are in the gutter
+  if (z >= 5)
+  {
+    for (int row = 0; row < size; row++)
+    {
+      for (int col = 0; col < size; col++)
+      {
+        size_t offset = static_cast<size_t>(row) * span + col;
+        int32_t o = owner[offset];
+        int32_t right = owner[offset + 1];
+        int32_t below = owner[offset + span];
+        if ((right != o || below != o) && (o >= 0 || right >= 0 || below >= 0))
+        {
+          fill[offset] = border_index;
+        }
+      }
+    }
+  }
+
+  for (int row = 0; row < size; row++)
+  {
+    std::copy(fill.begin() + static_cast<size_t>(row) * span, fill.begin() + static_cast<size_t>(row) * span + size,
+      pixels.begin() + static_cast<size_t>(row) * size);
+  }
+
+  return png_encode_indexed(size, size, palette, pixels);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// prerender
+// all tiles covering a county from zoom 0 to max_z for each year, through get() so they land in
+// both caches; tiles are shared out to worker threads through an atomic counter
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void raster_source_t::prerender(const std::vector<int>& years, int max_z, int threads)
+{
+  if (levels.empty())
+  {
+    return;
+  }
+  if (max_z > max_zoom)
+  {
+    max_z = max_zoom;
+  }
+  if (threads < 1)
+  {
+    threads = 1;
+  }
+
+  struct job_t
+  {
+    int year, z, x, y;
+  };
+  std::vector<job_t> jobs;
+  const std::vector<feature_t>& features = levels[0];
+  for (int z = 0; z <= max_z; z++)
+  {
+    int count = 1 << z;
+    std::set<std::pair<int, int>> keys;
+    for (size_t idx_feature = 0; idx_feature < features.size(); idx_feature++)
+    {
+      const feature_t& feature = features[idx_feature];
+      for (size_t idx = 0; idx < feature.bboxes.size(); idx++)
+      {
+        const BoundingBox& b = feature.bboxes[idx];
+        int x0 = std::max(0, static_cast<int>(std::floor(b.min_x * count)));
+        int x1 = std::min(count - 1, static_cast<int>(std::floor(b.max_x * count)));
+        int y0 = std::max(0, static_cast<int>(std::floor(b.min_y * count)));
+        int y1 = std::min(count - 1, static_cast<int>(std::floor(b.max_y * count)));
+        for (int tx = x0; tx <= x1; tx++)
+        {
+          for (int ty = y0; ty <= y1; ty++)
+          {
+            keys.insert(std::make_pair(tx, ty));
+          }
+        }
+      }
+    }
+    for (size_t idx = 0; idx < years.size(); idx++)
+    {
+      for (std::set<std::pair<int, int>>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+      {
+        jobs.push_back(job_t{ years[idx], z, it->first, it->second });
+      }
+    }
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> bytes(0);
+  std::vector<std::thread> workers;
+  for (int idx = 0; idx < threads; idx++)
+  {
+    workers.emplace_back([this, &jobs, &next, &bytes]()
+    {
+      for (size_t idx_job = next++; idx_job < jobs.size(); idx_job = next++)
+      {
+        const job_t& job = jobs[idx_job];
+        std::shared_ptr<const blob_t> tile = get(job.year, job.z, job.x, job.y);
+        if (tile)
+        {
+          bytes += tile->data.size();
+        }
+      }
+    });
+  }
+  for (size_t idx = 0; idx < workers.size(); idx++)
+  {
+    workers[idx].join();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Raster: " << jobs.size() << " tiles (zoom 0-" << max_z << ", " << years.size() << " years, "
+    << threads << " threads) in " << static_cast<int64_t>(seconds * 1000) << " ms, "
+    << (seconds > 0 ? static_cast<int64_t>(jobs.size() / seconds) : 0) << " tiles/s, "
+    << bytes / 1024 << " KB" << std::endl;
+}
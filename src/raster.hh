@@ -0,0 +1,70 @@
+#ifndef ELECTIONS_RASTER_HH
+#define ELECTIONS_RASTER_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include "geometry.hh"
+#include "payload.hh"
+#include "tiles.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// raster_source_t
+// server-side choropleth as 256x256 palette PNG tiles per year, for clients that cannot draw the
+// county polygons. Counties are scanline filled with their margin bucket color from the geometry
+// level of the tile zoom; borders are drawn from zoom 5. Tiles are cached in memory (LRU) and on
+// disk under <directory>/<version>/<z>/<x>/<y>.png, the version covers geometry and attributes.
+// Years changed by live updates are cached in memory only
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class raster_source_t
+{
+public:
+  static const int tile_size = 256;
+  static const int max_zoom = 12;
+
+  raster_source_t(payload_cache_t& cache, const std::vector<std::vector<shape_t>>& levels,
+    const std::string& geometry_version, const std::string& directory, size_t capacity);
+
+  std::string version(int year);
+  void invalidate(int year);
+  std::shared_ptr<const blob_t> get(int year, int z, int x, int y);
+  std::string render(int year, int z, int x, int y);
+  void prerender(const std::vector<int>& years, int max_z, int threads);
+
+private:
+  struct feature_t
+  {
+    uint64_t id;
+    multipolygon_t mercator;            // unit square, y down
+    std::vector<BoundingBox> bboxes;    // per polygon
+  };
+
+  struct colors_t
+  {
+    std::string version;
+    std::unordered_map<uint64_t, uint8_t> index;  // FIPS to palette index
+    bool live = false;                              // changed by live updates, not cached on disk
+  };
+
+  payload_cache_t& cache;
+  std::vector<std::vector<feature_t>> levels;  // per geometry level index
+  std::string geometry_version;
+  std::string directory;
+  lru_cache_t memory;
+  std::mutex mutex;
+  std::map<int, std::shared_ptr<const colors_t>> colors;
+  std::set<int> live_years;  // years invalidated by live updates
+
+  std::shared_ptr<const colors_t> get_colors(int year);
+  std::string tile_path(const std::string& version, int z, int x, int y) const;
+};
+
+std::string png_encode_indexed(int width, int height, const std::vector<uint32_t>& palette, const std::vector<uint8_t>& pixels);
+bool parse_raster_path(const std::string& path, int& year, int& z, int& x, int& y);
+
+#endif
@@ -0,0 +1,216 @@
+#include "resource.hh"
+#include <cstdlib>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_byte_range
+// single range "bytes=a-b", "bytes=a-" or "bytes=-n"; [begin, end) on success
+// multiple ranges are not supported, the caller serves the full body instead
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool parse_byte_range(const std::string& header, size_t size, size_t& begin, size_t& end)
+{
+  const std::string prefix = "bytes=";
+  if (header.compare(0, prefix.size(), prefix) != 0 || header.find(',') != std::string::npos)
+  {
+    return false;
+  }
+
+  std::string spec = header.substr(prefix.size());
+  size_t dash = spec.find('-');
+  if (dash == std::string::npos || size == 0)
+  {
+    return false;
+  }
+
+  std::string first = spec.substr(0, dash);
+  std::string last = spec.substr(dash + 1);
+
+  if (first.empty())
+  {
+    // suffix range, last n bytes
+    if (last.empty()) return false;
+    unsigned long long n = std::strtoull(last.c_str(), nullptr, 10);
+    if (n == 0) return false;
+    begin = (n >= size) ? 0 : size - static_cast<size_t>(n);
+    end = size;
+    return true;
+  }
+
+  unsigned long long a = std::strtoull(first.c_str(), nullptr, 10);
+  if (a >= size) return false;
+  unsigned long long b = last.empty() ? size - 1 : std::strtoull(last.c_str(), nullptr, 10);
+  if (b < a) return false;
+  if (b >= size) b = size - 1;
+
+  begin = static_cast<size_t>(a);
+  end = static_cast<size_t>(b) + 1;
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// accepts_encoding
+// true when the Accept-Encoding header lists the coding without q=0
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool accepts_encoding(const std::string& header, const std::string& coding)
+{
+  size_t pos = 0;
+  while (pos < header.size())
+  {
+    size_t comma = header.find(',', pos);
+    if (comma == std::string::npos) comma = header.size();
+    std::string item = header.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    size_t semicolon = item.find(';');
+    std::string token = item.substr(0, semicolon);
+    size_t first = token.find_first_not_of(" \t");
+    size_t last = token.find_last_not_of(" \t");
+    if (first == std::string::npos || token.substr(first, last - first + 1) != coding)
+    {
+      continue;
+    }
+
+    if (semicolon != std::string::npos)
+    {
+      size_t q = item.find("q=", semicolon);
+      if (q != std::string::npos && std::strtod(item.c_str() + q + 2, nullptr) <= 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// matches_etag
+// true when the If-None-Match header is "*" or lists the entity tag; weak tags (W/) compare
+// by their opaque part, as RFC 9110 requires for If-None-Match
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool matches_etag(const std::string& header, const std::string& etag)
+{
+  size_t pos = 0;
+  while (pos < header.size())
+  {
+    size_t comma = header.find(',', pos);
+    if (comma == std::string::npos) comma = header.size();
+    std::string item = header.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    size_t first = item.find_first_not_of(" \t");
+    if (first == std::string::npos)
+    {
+      continue;
+    }
+    size_t last = item.find_last_not_of(" \t");
+    std::string tag = item.substr(first, last - first + 1);
+    if (tag == "*")
+    {
+      return true;
+    }
+    if (tag.compare(0, 2, "W/") == 0)
+    {
+      tag = tag.substr(2);
+    }
+    if (tag == etag)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_resource_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+payload_resource_t::payload_resource_t(const lookup_t& lookup_) : lookup(lookup_)
+{
+}
+
+payload_resource_t::~payload_resource_t()
+{
+  beingDeleted();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// handleRequest
+// called concurrently from the server thread pool; the blob is immutable so no locking
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void payload_resource_t::handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+  std::shared_ptr<const blob_t> blob = lookup(request);
+  if (!blob)
+  {
+    response.setStatus(404);
+    return;
+  }
+
+  // pre-compressed variant, zstd preferred; each encoding is its own representation and ETag
+  std::string_view body = blob->body();
+  std::string_view gzip = blob->gzip_body();
+  std::string_view zstd = blob->zstd_body();
+  std::string encoding;
+  if (!gzip.empty() || !zstd.empty())
+  {
+    response.addHeader("Vary", "Accept-Encoding");
+    std::string accept = request.headerValue("Accept-Encoding");
+    if (!zstd.empty() && accepts_encoding(accept, "zstd"))
+    {
+      body = zstd;
+      encoding = "zstd";
+    }
+    else if (!gzip.empty() && accepts_encoding(accept, "gzip"))
+    {
+      body = gzip;
+      encoding = "gzip";
+    }
+  }
+
+  std::string etag = "\"" + blob->hash + (encoding.empty() ? "" : "-" + encoding) + "\"";
+  const std::string* version = request.getParameter("v");
+  bool versioned = version && *version == blob->hash;
+
+  response.addHeader("ETag", etag);
+  response.addHeader("Accept-Ranges", "bytes");
+  response.addHeader("Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+
+  if (matches_etag(request.headerValue("If-None-Match"), etag))
+  {
+    response.setStatus(304);
+    return;
+  }
+
+  response.setMimeType(blob->mime);
+  if (!encoding.empty())
+  {
+    response.addHeader("Content-Encoding", encoding);
+  }
+
+  size_t size = body.size();
+  size_t begin = 0;
+  size_t end = size;
+
+  std::string range = request.headerValue("Range");
+  std::string if_range = request.headerValue("If-Range");
+  bool single_range = range.find(',') == std::string::npos;
+  if (!range.empty() && single_range && (if_range.empty() || if_range == etag))
+  {
+    if (!parse_byte_range(range, size, begin, end))
+    {
+      response.setStatus(416);
+      response.addHeader("Content-Range", "bytes */" + std::to_string(size));
+      return;
+    }
+    response.setStatus(206);
+    response.addHeader("Content-Range", "bytes " + std::to_string(begin) + "-" +
+      std::to_string(end - 1) + "/" + std::to_string(size));
+  }
+
+  response.setContentLength(end - begin);
+  response.out().write(body.data() + begin, end - begin);
+}
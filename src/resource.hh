@@ -0,0 +1,36 @@
+#ifndef ELECTIONS_RESOURCE_HH
+#define ELECTIONS_RESOURCE_HH
+
+#include <Wt/WResource.h>
+#include <Wt/Http/Request.h>
+#include <Wt/Http/Response.h>
+#include <functional>
+#include <memory>
+#include "payload.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// payload_resource_t
+// serves an immutable blob_t with ETag, conditional GET and single byte range support;
+// the URL carries the content hash (?v=) so a matching request is cached as immutable.
+// Pre-compressed variants are chosen from Accept-Encoding
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class payload_resource_t : public Wt::WResource
+{
+public:
+  typedef std::function<std::shared_ptr<const blob_t>(const Wt::Http::Request&)> lookup_t;
+
+  payload_resource_t(const lookup_t& lookup);
+  ~payload_resource_t();
+
+  virtual void handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+
+private:
+  lookup_t lookup;
+};
+
+bool parse_byte_range(const std::string& header, size_t size, size_t& begin, size_t& end);
+bool accepts_encoding(const std::string& header, const std::string& coding);
+bool matches_etag(const std::string& header, const std::string& etag);
+
+#endif
@@ -0,0 +1,493 @@
+#include "snapshot.hh"
+#include "payload.hh"
+#include "data.hh"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char snapshot_magic[8] = { 'E', 'L', 'E', 'C', 'S', 'N', 'A', 'P' };
+static const uint32_t snapshot_byte_order = 0x01020304;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_t::open
+// null (error printed) when the file cannot be mapped, is not a snapshot, or was written with
+// another version or byte order
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const snapshot_t> snapshot_t::open(const std::string& path)
+{
+  std::shared_ptr<snapshot_t> snapshot(new snapshot_t());
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    std::cerr << "Cannot open snapshot " << path << std::endl;
+    return nullptr;
+  }
+  snapshot->file = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    std::cerr << "Empty snapshot " << path << std::endl;
+    return nullptr;
+  }
+  snapshot->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (snapshot->mapping)
+  {
+    snapshot->data = static_cast<const char*>(MapViewOfFile(snapshot->mapping, FILE_MAP_READ, 0, 0, 0));
+    snapshot->length = static_cast<size_t>(size.QuadPart);
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Cannot open snapshot " << path << std::endl;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    std::cerr << "Empty snapshot " << path << std::endl;
+    return nullptr;
+  }
+  void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr != MAP_FAILED)
+  {
+    snapshot->data = static_cast<const char*>(addr);
+    snapshot->length = static_cast<size_t>(st.st_size);
+  }
+#endif
+
+  if (!snapshot->data)
+  {
+    std::cerr << "Cannot map snapshot " << path << std::endl;
+    return nullptr;
+  }
+
+  std::string_view in(snapshot->data, snapshot->length);
+  uint32_t version = 0;
+  uint32_t byte_order = 0;
+  uint64_t count = 0;
+  if (in.substr(0, sizeof(snapshot_magic)) != std::string_view(snapshot_magic, sizeof(snapshot_magic)))
+  {
+    std::cerr << path << " is not a snapshot" << std::endl;
+    return nullptr;
+  }
+  in.remove_prefix(sizeof(snapshot_magic));
+  if (!get_value(in, version) || !get_value(in, byte_order) || !get_value(in, count))
+  {
+    std::cerr << "Truncated snapshot " << path << std::endl;
+    return nullptr;
+  }
+  if (version != snapshot_version || byte_order != snapshot_byte_order)
+  {
+    std::cerr << "Snapshot " << path << " has version " << version << ", expected " << snapshot_version
+      << " on this machine; rerun the loader with --snapshot" << std::endl;
+    return nullptr;
+  }
+
+  for (uint64_t idx = 0; idx < count; idx++)
+  {
+    std::string_view name;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    if (!get_string(in, name) || !get_value(in, offset) || !get_value(in, size) ||
+      offset > snapshot->length || size > snapshot->length - offset)
+    {
+      std::cerr << "Truncated snapshot " << path << std::endl;
+      return nullptr;
+    }
+    snapshot->sections[std::string(name)] = std::string_view(snapshot->data + offset, static_cast<size_t>(size));
+  }
+
+  return snapshot;
+}
+
+snapshot_t::~snapshot_t()
+{
+#ifdef _WIN32
+  if (data) UnmapViewOfFile(data);
+  if (mapping) CloseHandle(mapping);
+  if (file) CloseHandle(file);
+#else
+  if (data) munmap(const_cast<char*>(data), length);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_t::section
+// empty view when the section is missing
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string_view snapshot_t::section(const std::string& name) const
+{
+  std::map<std::string, std::string_view>::const_iterator it = sections.find(name);
+  return (it == sections.end()) ? std::string_view() : it->second;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_writer_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string& snapshot_writer_t::section(const std::string& name)
+{
+  sections.emplace_back(name, std::string());
+  return sections.back().second;
+}
+
+bool snapshot_writer_t::write(const std::string& path) const
+{
+  // the table is sized first: each entry is the name and two 64 bit values
+  std::string header(snapshot_magic, sizeof(snapshot_magic));
+  put_value<uint32_t>(header, snapshot_version);
+  put_value<uint32_t>(header, snapshot_byte_order);
+  put_value<uint64_t>(header, sections.size());
+  uint64_t offset = header.size();
+  for (size_t idx = 0; idx < sections.size(); idx++)
+  {
+    offset += sizeof(uint64_t) + sections[idx].first.size() + 2 * sizeof(uint64_t);
+  }
+  for (size_t idx = 0; idx < sections.size(); idx++)
+  {
+    put_string(header, sections[idx].first);
+    put_value<uint64_t>(header, offset);
+    put_value<uint64_t>(header, sections[idx].second.size());
+    offset += sections[idx].second.size();
+  }
+
+  std::string temp = path + ".tmp";
+  std::ofstream file(temp, std::ios::binary);
+  if (!file.is_open())
+  {
+    return false;
+  }
+  file.write(header.data(), header.size());
+  for (size_t idx = 0; idx < sections.size(); idx++)
+  {
+    file.write(sections[idx].second.data(), sections[idx].second.size());
+  }
+  file.close();
+
+  std::error_code error;
+  if (!file)
+  {
+    std::filesystem::remove(temp, error);
+    return false;
+  }
+  std::filesystem::rename(temp, path, error);
+  return !error;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_blob, read_blob
+// hash, mime and the three bodies; a blob read back serves its bodies from the mapping
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_blob(std::string& out, const blob_t& blob)
+{
+  put_string(out, blob.hash);
+  put_string(out, blob.mime);
+  put_string(out, blob.body());
+  put_string(out, blob.gzip_body());
+  put_string(out, blob.zstd_body());
+}
+
+static std::shared_ptr<const blob_t> read_blob(const std::shared_ptr<const snapshot_t>& snapshot, const std::string& name)
+{
+  std::string_view in = snapshot->section(name);
+  std::string_view hash;
+  std::string_view mime;
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  if (!get_string(in, hash) || !get_string(in, mime) || !get_string(in, blob->mapped_data) ||
+    !get_string(in, blob->mapped_gzip) || !get_string(in, blob->mapped_zstd))
+  {
+    return nullptr;
+  }
+  blob->hash = hash;
+  blob->mime = mime;
+  blob->owner = snapshot;
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_states, read_states
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_states(std::string& out, const std::vector<state_record>& states)
+{
+  put_value<uint64_t>(out, states.size());
+  for (size_t idx = 0; idx < states.size(); idx++)
+  {
+    const state_record& rec = states[idx];
+    put_string(out, rec.fips);
+    put_string(out, rec.name);
+    put_string(out, rec.winner);
+    put_value(out, rec.votes_gop);
+    put_value(out, rec.votes_dem);
+    put_value(out, rec.votes_total);
+    put_value(out, rec.per_gop);
+    put_value(out, rec.per_dem);
+  }
+}
+
+static bool read_states(std::string_view& in, std::vector<state_record>& states)
+{
+  uint64_t count = 0;
+  if (!get_value(in, count))
+  {
+    return false;
+  }
+  states.resize(static_cast<size_t>(std::min<uint64_t>(count, in.size())));
+  for (size_t idx = 0; idx < states.size(); idx++)
+  {
+    state_record& rec = states[idx];
+    std::string_view fips, name, winner;
+    if (!get_string(in, fips) || !get_string(in, name) || !get_string(in, winner) ||
+      !get_value(in, rec.votes_gop) || !get_value(in, rec.votes_dem) || !get_value(in, rec.votes_total) ||
+      !get_value(in, rec.per_gop) || !get_value(in, rec.per_dem))
+    {
+      return false;
+    }
+    rec.fips = fips;
+    rec.name = name;
+    rec.winner = winner;
+  }
+  return states.size() == count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_shapes, read_snapshot_shapes
+// decoded coordinates as they are held in memory, so reading copies arrays instead of
+// decoding WKB
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_shapes(std::string& out, const std::vector<shape_t>& shapes)
+{
+  put_value<uint64_t>(out, shapes.size());
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    const shape_t& shape = shapes[idx];
+    put_string(out, shape.fips);
+    put_string(out, shape.name);
+    put_string(out, shape.state_name);
+    put_value(out, shape.bbox);
+    put_value<uint64_t>(out, shape.polygons.size());
+    for (size_t idx_polygon = 0; idx_polygon < shape.polygons.size(); idx_polygon++)
+    {
+      const polygon_t& polygon = shape.polygons[idx_polygon];
+      put_value<uint64_t>(out, polygon.size());
+      for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+      {
+        put_array(out, polygon[idx_ring]);
+      }
+    }
+  }
+}
+
+std::vector<shape_t> read_snapshot_shapes(const snapshot_t& snapshot, int level)
+{
+  std::vector<shape_t> shapes;
+  std::string_view in = snapshot.section("shapes/" + std::to_string(level));
+  uint64_t count = 0;
+  if (!get_value(in, count))
+  {
+    return shapes;
+  }
+  shapes.reserve(static_cast<size_t>(std::min<uint64_t>(count, in.size())));
+  for (uint64_t idx = 0; idx < count; idx++)
+  {
+    shape_t shape;
+    std::string_view fips, name, state_name;
+    uint64_t polygons = 0;
+    if (!get_string(in, fips) || !get_string(in, name) || !get_string(in, state_name) ||
+      !get_value(in, shape.bbox) || !get_value(in, polygons))
+    {
+      std::cerr << "Truncated shapes of level " << level << " in snapshot" << std::endl;
+      return std::vector<shape_t>();
+    }
+    shape.fips = fips;
+    shape.name = name;
+    shape.state_name = state_name;
+    for (uint64_t idx_polygon = 0; idx_polygon < polygons; idx_polygon++)
+    {
+      uint64_t rings = 0;
+      if (!get_value(in, rings))
+      {
+        return std::vector<shape_t>();
+      }
+      shape.polygons.emplace_back();
+      for (uint64_t idx_ring = 0; idx_ring < rings; idx_ring++)
+      {
+        shape.polygons.back().emplace_back();
+        if (!get_array(in, shape.polygons.back().back()))
+        {
+          return std::vector<shape_t>();
+        }
+      }
+    }
+    shapes.push_back(std::move(shape));
+  }
+  return shapes;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_snapshot_tiles
+// the pre-generated vector tiles of the tiles table
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<tile_record> read_snapshot_tiles(const snapshot_t& snapshot)
+{
+  std::vector<tile_record> tiles;
+  std::string_view in = snapshot.section("tiles");
+  uint64_t count = 0;
+  if (!get_value(in, count))
+  {
+    return tiles;
+  }
+  for (uint64_t idx = 0; idx < count; idx++)
+  {
+    tile_record t;
+    int32_t z = 0, x = 0, y = 0;
+    std::string_view data;
+    if (!get_value(in, z) || !get_value(in, x) || !get_value(in, y) || !get_string(in, data))
+    {
+      break;
+    }
+    t.z = z;
+    t.x = x;
+    t.y = y;
+    t.data = data;
+    tiles.push_back(std::move(t));
+  }
+  return tiles;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_snapshot_payload
+// a year as payload_cache_t::build makes it: the column table and aggregates are copied,
+// the attribute blobs stay in the mapping. Null when the year is not in the snapshot
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const year_payload_t> read_snapshot_payload(const std::shared_ptr<const snapshot_t>& snapshot, int year)
+{
+  std::string key = std::to_string(year);
+  std::shared_ptr<year_payload_t> payload = std::make_shared<year_payload_t>();
+  payload->year = year;
+
+  std::string_view counties = snapshot->section("counties/" + key);
+  std::string_view states = snapshot->section("states/" + key);
+  std::string_view national = snapshot->section("national/" + key);
+  std::shared_ptr<const blob_t> attributes = read_blob(snapshot, "attributes/" + key);
+  std::shared_ptr<const blob_t> state_attributes = read_blob(snapshot, "state_attributes/" + key);
+  if (!payload->counties.read(counties) || !read_states(states, payload->states) ||
+    !get_value(national, payload->national.votes_gop) || !get_value(national, payload->national.votes_dem) ||
+    !get_value(national, payload->national.votes_total) || !attributes || !state_attributes)
+  {
+    return nullptr;
+  }
+  payload->attributes = *attributes;
+  payload->state_attributes = *state_attributes;
+  return payload;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// read_snapshot_blob
+// geometry and state geometry documents by section name; null when missing
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> read_snapshot_blob(const std::shared_ptr<const snapshot_t>& snapshot, const std::string& name)
+{
+  return snapshot->has(name) ? read_blob(snapshot, name) : nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// write_snapshot
+// everything the server builds at startup: the payload of every year with its compressed
+// variants, the geometry documents of every level and format, the swing of every year pair, the
+// shapes the tile and raster renderers project, and the pre-generated tiles
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int write_snapshot(const std::string& path, payload_cache_t& cache, database_t& db)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  cache.build_all();
+
+  snapshot_writer_t writer;
+  std::vector<int> years = cache.get_years();
+  put_array(writer.section("years"), years);
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    std::string key = std::to_string(years[idx]);
+    std::shared_ptr<const year_payload_t> payload = cache.get(years[idx]);
+    payload->counties.write(writer.section("counties/" + key));
+    write_states(writer.section("states/" + key), payload->states);
+    std::string& national = writer.section("national/" + key);
+    put_value(national, payload->national.votes_gop);
+    put_value(national, payload->national.votes_dem);
+    put_value(national, payload->national.votes_total);
+    write_blob(writer.section("attributes/" + key), payload->attributes);
+    write_blob(writer.section("state_attributes/" + key), payload->state_attributes);
+  }
+
+  for (int idx = 0; idx < geometry_level_count; idx++)
+  {
+    int level = geometry_levels[idx].level;
+    std::string key = std::to_string(level);
+    write_blob(writer.section("geometry/" + key), *cache.get_geometry(level));
+    write_blob(writer.section("topojson/" + key), *cache.get_topojson(level));
+    write_blob(writer.section("binary/" + key), *cache.get_binary(level));
+    write_shapes(writer.section("shapes/" + key), db.get_shapes(level));
+  }
+  write_blob(writer.section("state_geometry"), *cache.get_state_geometry());
+
+  // every year pair, not only those build_all warms
+  for (size_t idx = 0; idx < years.size(); idx++)
+  {
+    for (size_t idx_base = 0; idx_base < years.size(); idx_base++)
+    {
+      std::shared_ptr<const blob_t> blob = cache.get_swing(years[idx], years[idx_base]);
+      if (blob)
+      {
+        write_blob(writer.section("swing/" + std::to_string(years[idx]) + "/" + std::to_string(years[idx_base])), *blob);
+      }
+    }
+  }
+
+  std::vector<tile_record> tiles = db.get_tiles();
+  std::string& tiles_section = writer.section("tiles");
+  put_value<uint64_t>(tiles_section, tiles.size());
+  for (size_t idx = 0; idx < tiles.size(); idx++)
+  {
+    put_value<int32_t>(tiles_section, tiles[idx].z);
+    put_value<int32_t>(tiles_section, tiles[idx].x);
+    put_value<int32_t>(tiles_section, tiles[idx].y);
+    put_string(tiles_section, tiles[idx].data);
+  }
+
+  if (!writer.write(path))
+  {
+    std::cerr << "Cannot write snapshot " << path << std::endl;
+    return -1;
+  }
+
+  std::error_code error;
+  uintmax_t size = std::filesystem::file_size(path, error);
+  std::cout << "Snapshot " << path << ": " << years.size() << " years, " << (error ? 0 : size) << " bytes in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+    << " ms" << std::endl;
+  return static_cast<int>(years.size());
+}
@@ -0,0 +1,149 @@
+#ifndef ELECTIONS_SNAPSHOT_HH
+#define ELECTIONS_SNAPSHOT_HH
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include "geometry.hh"
+
+class database_t;
+class payload_cache_t;
+struct blob_t;
+struct year_payload_t;
+struct tile_record;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_version
+// bumped whenever the layout of a section changes; other versions are rejected when opened
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const uint32_t snapshot_version = 1;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// put_value, put_string, put_array
+// section encoding: fixed width values in host byte order, strings and arrays prefixed by their
+// 64 bit length. The snapshot is read on the machine type that wrote it
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+void put_value(std::string& out, T value)
+{
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void put_string(std::string& out, std::string_view str)
+{
+  put_value<uint64_t>(out, str.size());
+  out.append(str.data(), str.size());
+}
+
+template<typename T>
+void put_array(std::string& out, const std::vector<T>& values)
+{
+  put_value<uint64_t>(out, values.size());
+  out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get_value, get_string, get_array
+// read from the front of a section and advance it; false when the section is too short.
+// Strings are views into the mapping, arrays are copied
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+bool get_value(std::string_view& in, T& value)
+{
+  if (in.size() < sizeof(T))
+  {
+    return false;
+  }
+  std::memcpy(&value, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+inline bool get_string(std::string_view& in, std::string_view& str)
+{
+  uint64_t size = 0;
+  if (!get_value(in, size) || in.size() < size)
+  {
+    return false;
+  }
+  str = in.substr(0, size);
+  in.remove_prefix(size);
+  return true;
+}
+
+template<typename T>
+bool get_array(std::string_view& in, std::vector<T>& values)
+{
+  uint64_t count = 0;
+  if (!get_value(in, count) || in.size() / sizeof(T) < count)
+  {
+    return false;
+  }
+  values.resize(count);
+  std::memcpy(values.data(), in.data(), count * sizeof(T));
+  in.remove_prefix(count * sizeof(T));
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_t
+// read-only memory mapping of a snapshot file: a header, a table of named sections, then the
+// sections. Opening reads only the table; section contents are paged in when first touched
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class snapshot_t
+{
+public:
+  static std::shared_ptr<const snapshot_t> open(const std::string& path);
+  ~snapshot_t();
+
+  bool has(const std::string& name) const { return sections.count(name) > 0; }
+  std::string_view section(const std::string& name) const;
+  size_t size() const { return length; }
+
+private:
+  snapshot_t() = default;
+  snapshot_t(const snapshot_t&) = delete;
+  snapshot_t& operator=(const snapshot_t&) = delete;
+
+  const char* data = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void* file = nullptr;
+  void* mapping = nullptr;
+#endif
+  std::map<std::string, std::string_view> sections;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// snapshot_writer_t
+// sections are built in memory (a returned section stays valid while others are added) and
+// written in one pass, to a temporary file renamed over the target, so a running server never
+// maps a partial file
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class snapshot_writer_t
+{
+public:
+  std::string& section(const std::string& name);
+  bool write(const std::string& path) const;
+
+private:
+  std::deque<std::pair<std::string, std::string>> sections;
+};
+
+int write_snapshot(const std::string& path, payload_cache_t& cache, database_t& db);
+std::shared_ptr<const year_payload_t> read_snapshot_payload(const std::shared_ptr<const snapshot_t>& snapshot, int year);
+std::shared_ptr<const blob_t> read_snapshot_blob(const std::shared_ptr<const snapshot_t>& snapshot, const std::string& name);
+std::vector<shape_t> read_snapshot_shapes(const snapshot_t& snapshot, int level);
+std::vector<tile_record> read_snapshot_tiles(const snapshot_t& snapshot);
+
+#endif
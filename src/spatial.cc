@@ -1,5 +1,8 @@
 #include "spatial.hh"
 #include "duckdb.hpp"
+#ifdef ELECTIONS_SPATIAL_STATIC
+#include "spatial_extension.hpp"
+#endif
 #include <iostream>
 #include <sstream>
 
@@ -67,15 +70,46 @@ SpatialClient::~SpatialClient()
 
 bool SpatialClient::init_spatial()
 {
-  duckdb::unique_ptr<duckdb::MaterializedQueryResult> result = conn->Query("INSTALL spatial");
-  if (result->HasError())
+  return load_spatial(*db, *conn);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// load_spatial
+// with ELECTIONS_SPATIAL_STATIC (the default build) the extension is linked into the executable
+// and loaded in-process, with no network or extension cache; otherwise it is installed and
+// loaded at runtime. Either way a geometry query must then succeed; false (error printed) if not
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool load_spatial(duckdb::DuckDB& db, duckdb::Connection& conn)
+{
+#ifdef ELECTIONS_SPATIAL_STATIC
+  try
   {
+    db.LoadStaticExtension<duckdb::SpatialExtension>();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Cannot load the spatial extension: " << e.what() << std::endl;
     return false;
   }
+#else
+  (void)db;
+  const char* statements[] = { "INSTALL spatial", "LOAD spatial" };
+  for (size_t idx = 0; idx < 2; idx++)
+  {
+    duckdb::unique_ptr<duckdb::MaterializedQueryResult> result = conn.Query(statements[idx]);
+    if (result->HasError())
+    {
+      std::cerr << statements[idx] << ": " << result->GetError() << std::endl;
+      return false;
+    }
+  }
+#endif
 
-  result = conn->Query("LOAD spatial");
+  duckdb::unique_ptr<duckdb::MaterializedQueryResult> result = conn.Query("SELECT ST_AsText(ST_Point(0, 0))");
   if (result->HasError())
   {
+    std::cerr << "Spatial extension not available: " << result->GetError() << std::endl;
     return false;
   }
   return true;
@@ -96,3 +96,8 @@ private:
   std::string escape(const std::string& s);
 };
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// load_spatial
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool load_spatial(duckdb::DuckDB& db, duckdb::Connection& conn);
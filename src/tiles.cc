@@ -0,0 +1,607 @@
+#include "tiles.hh"
+#include <cmath>
+#include <cstdlib>
+#include <set>
+#include <algorithm>
+#include <iostream>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tile geometry constants
+// extent and buffer in tile units; tolerance is the Douglas-Peucker distance, also in tile units,
+// so the simplification is per zoom level in world units
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const int tile_extent = 4096;
+static const int tile_buffer = 64;
+static const double tile_tolerance = 2.0;
+static const double pi = 3.14159265358979323846;
+
+struct tile_point_t
+{
+  int32_t x;
+  int32_t y;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tile_key
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t tile_key(int z, int x, int y)
+{
+  return (static_cast<uint64_t>(z) << 58) | (static_cast<uint64_t>(x) << 29) | static_cast<uint64_t>(y);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_tile_path
+// "/z/x/y<suffix>", as in the path info of /tiles/4/3/6.mvt
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool parse_tile_path(const std::string& path, const std::string& suffix, int& z, int& x, int& y)
+{
+  if (path.size() <= suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0)
+  {
+    return false;
+  }
+
+  std::string body = path.substr(0, path.size() - suffix.size());
+  int values[3];
+  size_t pos = 0;
+  for (int idx = 0; idx < 3; idx++)
+  {
+    if (pos >= body.size() || body[pos] != '/') return false;
+    pos++;
+    size_t start = pos;
+    while (pos < body.size() && body[pos] >= '0' && body[pos] <= '9') pos++;
+    if (pos == start || pos - start > 9) return false;
+    values[idx] = std::atoi(body.substr(start, pos - start).c_str());
+  }
+  if (pos != body.size()) return false;
+
+  z = values[0];
+  x = values[1];
+  y = values[2];
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// to_mercator
+// web mercator in the unit square, y down
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Point2D to_mercator(const Point2D& p)
+{
+  const double max_lat = 85.0511287798;
+  double lat = p.y > max_lat ? max_lat : (p.y < -max_lat ? -max_lat : p.y);
+  double sin_lat = std::sin(lat * pi / 180.0);
+  double x = (p.x + 180.0) / 360.0;
+  double y = 0.5 - std::log((1.0 + sin_lat) / (1.0 - sin_lat)) / (4.0 * pi);
+  return Point2D(x, y);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// clip_ring
+// Sutherland-Hodgman against the square [min, max]; input and output are open rings
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void clip_axis(const std::vector<Point2D>& in, std::vector<Point2D>& out, bool axis_x, double value, bool keep_less)
+{
+  out.clear();
+  size_t n = in.size();
+  for (size_t idx = 0; idx < n; idx++)
+  {
+    const Point2D& a = in[idx];
+    const Point2D& b = in[(idx + 1) % n];
+    double va = axis_x ? a.x : a.y;
+    double vb = axis_x ? b.x : b.y;
+    bool inside_a = keep_less ? va <= value : va >= value;
+    bool inside_b = keep_less ? vb <= value : vb >= value;
+
+    if (inside_a)
+    {
+      out.push_back(a);
+    }
+    if (inside_a != inside_b)
+    {
+      double t = (value - va) / (vb - va);
+      out.push_back(Point2D(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)));
+    }
+  }
+}
+
+static void clip_ring(std::vector<Point2D>& ring, double min, double max)
+{
+  std::vector<Point2D> tmp;
+  clip_axis(ring, tmp, true, min, false);
+  clip_axis(tmp, ring, true, max, true);
+  clip_axis(ring, tmp, false, min, false);
+  clip_axis(tmp, ring, false, max, true);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// simplify_ring
+// Douglas-Peucker on a closed ring (first == last); the first point is always kept
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double segment_distance2(const tile_point_t& p, const tile_point_t& a, const tile_point_t& b)
+{
+  double dx = b.x - a.x;
+  double dy = b.y - a.y;
+  double px = p.x - a.x;
+  double py = p.y - a.y;
+  double len2 = dx * dx + dy * dy;
+  if (len2 > 0)
+  {
+    double t = (px * dx + py * dy) / len2;
+    if (t > 1) t = 1;
+    if (t > 0)
+    {
+      px -= t * dx;
+      py -= t * dy;
+    }
+  }
+  return px * px + py * py;
+}
+
+static void simplify_ring(std::vector<tile_point_t>& ring, double tolerance)
+{
+  size_t n = ring.size();
+  if (n <= 4)
+  {
+    return;
+  }
+
+  std::vector<char> keep(n, 0);
+  keep[0] = 1;
+  keep[n - 1] = 1;
+
+  double tolerance2 = tolerance * tolerance;
+  std::vector<std::pair<size_t, size_t>> stack;
+  stack.push_back(std::make_pair(static_cast<size_t>(0), n - 1));
+  while (!stack.empty())
+  {
+    size_t first = stack.back().first;
+    size_t last = stack.back().second;
+    stack.pop_back();
+
+    double max_dist = 0;
+    size_t index = 0;
+    for (size_t idx = first + 1; idx < last; idx++)
+    {
+      double dist = segment_distance2(ring[idx], ring[first], ring[last]);
+      if (dist > max_dist)
+      {
+        max_dist = dist;
+        index = idx;
+      }
+    }
+
+    if (max_dist > tolerance2)
+    {
+      keep[index] = 1;
+      stack.push_back(std::make_pair(first, index));
+      stack.push_back(std::make_pair(index, last));
+    }
+  }
+
+  size_t count = 0;
+  for (size_t idx = 0; idx < n; idx++)
+  {
+    if (keep[idx]) ring[count++] = ring[idx];
+  }
+  ring.resize(count);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// protobuf encoding
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void write_varint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+static void write_key(std::string& out, uint32_t field, uint32_t wire_type)
+{
+  write_varint(out, (field << 3) | wire_type);
+}
+
+static void write_bytes(std::string& out, uint32_t field, const std::string& bytes)
+{
+  write_key(out, field, 2);
+  write_varint(out, bytes.size());
+  out += bytes;
+}
+
+static void write_packed(std::string& out, uint32_t field, const std::vector<uint32_t>& values)
+{
+  std::string packed;
+  for (size_t idx = 0; idx < values.size(); idx++)
+  {
+    write_varint(packed, values[idx]);
+  }
+  write_bytes(out, field, packed);
+}
+
+static uint32_t zigzag(int32_t value)
+{
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static uint32_t command(uint32_t id, uint32_t count)
+{
+  return (id & 0x7) | (count << 3);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// lru_cache_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+lru_cache_t::lru_cache_t(size_t capacity_) : capacity(capacity_)
+{
+}
+
+std::shared_ptr<const blob_t> lru_cache_t::get(uint64_t key)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unordered_map<uint64_t, std::list<entry_t>::iterator>::iterator it = index.find(key);
+  if (it == index.end())
+  {
+    return nullptr;
+  }
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->second;
+}
+
+void lru_cache_t::put(uint64_t key, const std::shared_ptr<const blob_t>& blob)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unordered_map<uint64_t, std::list<entry_t>::iterator>::iterator it = index.find(key);
+  if (it != index.end())
+  {
+    it->second->second = blob;
+    entries.splice(entries.begin(), entries, it->second);
+    return;
+  }
+
+  entries.push_front(std::make_pair(key, blob));
+  index[key] = entries.begin();
+  while (entries.size() > capacity)
+  {
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tile_source_t
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+tile_source_t::tile_source_t(std::vector<shape_t> shapes_, const std::string& version_, size_t capacity)
+  : shapes(std::move(shapes_)), version(version_), cache(capacity)
+{
+  for (size_t idx_shape = 0; idx_shape < shapes.size(); idx_shape++)
+  {
+    const shape_t& shape = shapes[idx_shape];
+    feature_t feature;
+    feature.id = std::strtoull(shape.fips.c_str(), nullptr, 10);
+    feature.shape = idx_shape;
+    feature.mercator = shape.polygons;
+    for (size_t idx_polygon = 0; idx_polygon < feature.mercator.size(); idx_polygon++)
+    {
+      polygon_t& polygon = feature.mercator[idx_polygon];
+      for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+      {
+        ring_t& ring = polygon[idx_ring];
+        for (size_t idx = 0; idx < ring.size(); idx++)
+        {
+          ring[idx] = to_mercator(ring[idx]);
+        }
+      }
+      feature.bboxes.push_back(bounding_box(polygon));
+    }
+    features.push_back(std::move(feature));
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// preload
+// tiles pre-generated by loader; kept for the lifetime of the process, outside the LRU
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void tile_source_t::preload(const std::vector<tile_record>& tiles)
+{
+  for (size_t idx = 0; idx < tiles.size(); idx++)
+  {
+    const tile_record& t = tiles[idx];
+    pregenerated[tile_key(t.z, t.x, t.y)] = make_blob(t.data);
+  }
+  std::cout << "Preloaded " << tiles.size() << " tiles" << std::endl;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// get
+// thread safe; concurrent misses on the same tile may both render, the last one is cached
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> tile_source_t::get(int z, int x, int y)
+{
+  if (z < 0 || z > max_zoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z))
+  {
+    return nullptr;
+  }
+
+  uint64_t key = tile_key(z, x, y);
+  std::unordered_map<uint64_t, std::shared_ptr<const blob_t>>::const_iterator it = pregenerated.find(key);
+  if (it != pregenerated.end())
+  {
+    return it->second;
+  }
+
+  std::shared_ptr<const blob_t> blob = cache.get(key);
+  if (blob)
+  {
+    return blob;
+  }
+
+  blob = make_blob(render(z, x, y));
+  cache.put(key, blob);
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// make_blob
+// the ETag is the geometry version, shared by all tiles since an ETag is scoped to its URL
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const blob_t> tile_source_t::make_blob(const std::string& data) const
+{
+  std::shared_ptr<blob_t> blob = std::make_shared<blob_t>();
+  blob->data = data;
+  blob->hash = version;
+  blob->mime = "application/vnd.mapbox-vector-tile";
+  return blob;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// render
+// one 'counties' layer; empty string when no county intersects the tile
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string tile_source_t::render(int z, int x, int y) const
+{
+  double scale = static_cast<double>(1 << z);
+  double margin = static_cast<double>(tile_buffer) / tile_extent;
+  BoundingBox tile_bbox((x - margin) / scale, (y - margin) / scale, (x + 1 + margin) / scale, (y + 1 + margin) / scale);
+
+  std::string layer;
+  std::vector<std::string> values;
+  std::unordered_map<std::string, uint32_t> value_index;
+
+  std::vector<Point2D> clipped;
+  std::vector<tile_point_t> points;
+
+  for (size_t idx_feature = 0; idx_feature < features.size(); idx_feature++)
+  {
+    const feature_t& feature = features[idx_feature];
+    std::vector<uint32_t> geometry;
+    int32_t cursor_x = 0;
+    int32_t cursor_y = 0;
+
+    for (size_t idx_polygon = 0; idx_polygon < feature.mercator.size(); idx_polygon++)
+    {
+      const BoundingBox& b = feature.bboxes[idx_polygon];
+      if (b.max_x < tile_bbox.min_x || b.min_x > tile_bbox.max_x || b.max_y < tile_bbox.min_y || b.min_y > tile_bbox.max_y)
+      {
+        continue;
+      }
+
+      const polygon_t& polygon = feature.mercator[idx_polygon];
+      for (size_t idx_ring = 0; idx_ring < polygon.size(); idx_ring++)
+      {
+        const ring_t& ring = polygon[idx_ring];
+        if (ring.size() < 4)
+        {
+          continue;
+        }
+
+        // tile coordinates, open ring
+        clipped.clear();
+        for (size_t idx = 0; idx + 1 < ring.size(); idx++)
+        {
+          clipped.push_back(Point2D((ring[idx].x * scale - x) * tile_extent, (ring[idx].y * scale - y) * tile_extent));
+        }
+        clip_ring(clipped, -tile_buffer, tile_extent + tile_buffer);
+
+        // round to the tile grid and drop repeated points, then close
+        points.clear();
+        for (size_t idx = 0; idx < clipped.size(); idx++)
+        {
+          tile_point_t p;
+          p.x = static_cast<int32_t>(std::lround(clipped[idx].x));
+          p.y = static_cast<int32_t>(std::lround(clipped[idx].y));
+          if (points.empty() || points.back().x != p.x || points.back().y != p.y)
+          {
+            points.push_back(p);
+          }
+        }
+        while (points.size() > 1 && points.back().x == points.front().x && points.back().y == points.front().y)
+        {
+          points.pop_back();
+        }
+        if (points.size() < 3)
+        {
+          if (idx_ring == 0) break;
+          continue;
+        }
+        points.push_back(points.front());
+        simplify_ring(points, tile_tolerance);
+        points.pop_back();
+        if (points.size() < 3)
+        {
+          if (idx_ring == 0) break;
+          continue;
+        }
+
+        // exterior rings have positive area in tile coordinates (y down), holes negative
+        int64_t area = 0;
+        for (size_t idx = 0; idx < points.size(); idx++)
+        {
+          const tile_point_t& a = points[idx];
+          const tile_point_t& b2 = points[(idx + 1) % points.size()];
+          area += static_cast<int64_t>(a.x) * b2.y - static_cast<int64_t>(b2.x) * a.y;
+        }
+        if (area == 0)
+        {
+          if (idx_ring == 0) break;
+          continue;
+        }
+        if ((idx_ring == 0) != (area > 0))
+        {
+          std::reverse(points.begin(), points.end());
+        }
+
+        geometry.push_back(command(1, 1));
+        geometry.push_back(zigzag(points[0].x - cursor_x));
+        geometry.push_back(zigzag(points[0].y - cursor_y));
+        cursor_x = points[0].x;
+        cursor_y = points[0].y;
+        geometry.push_back(command(2, static_cast<uint32_t>(points.size() - 1)));
+        for (size_t idx = 1; idx < points.size(); idx++)
+        {
+          geometry.push_back(zigzag(points[idx].x - cursor_x));
+          geometry.push_back(zigzag(points[idx].y - cursor_y));
+          cursor_x = points[idx].x;
+          cursor_y = points[idx].y;
+        }
+        geometry.push_back(command(7, 1));
+      }
+    }
+
+    if (geometry.empty())
+    {
+      continue;
+    }
+
+    // tags: keys are fixed (fips, name, state), values are deduplicated per layer
+    const shape_t& shape = shapes[feature.shape];
+    const std::string* strings[3] = { &shape.fips, &shape.name, &shape.state_name };
+    std::vector<uint32_t> tags;
+    for (uint32_t idx_key = 0; idx_key < 3; idx_key++)
+    {
+      std::unordered_map<std::string, uint32_t>::iterator it = value_index.find(*strings[idx_key]);
+      uint32_t idx_value;
+      if (it == value_index.end())
+      {
+        idx_value = static_cast<uint32_t>(values.size());
+        value_index[*strings[idx_key]] = idx_value;
+        values.push_back(*strings[idx_key]);
+      }
+      else
+      {
+        idx_value = it->second;
+      }
+      tags.push_back(idx_key);
+      tags.push_back(idx_value);
+    }
+
+    std::string message;
+    write_key(message, 1, 0);
+    write_varint(message, feature.id);
+    write_packed(message, 2, tags);
+    write_key(message, 3, 0);
+    write_varint(message, 3);  // POLYGON
+    write_packed(message, 4, geometry);
+    write_bytes(layer, 2, message);
+  }
+
+  if (layer.empty())
+  {
+    return "";
+  }
+
+  std::string header;
+  write_key(header, 15, 0);
+  write_varint(header, 2);
+  write_bytes(header, 1, "counties");
+  layer = header + layer;
+
+  const char* keys[3] = { "fips", "name", "state" };
+  for (int idx = 0; idx < 3; idx++)
+  {
+    write_bytes(layer, 3, keys[idx]);
+  }
+  for (size_t idx = 0; idx < values.size(); idx++)
+  {
+    std::string value;
+    write_bytes(value, 1, values[idx]);
+    write_bytes(layer, 4, value);
+  }
+  write_key(layer, 5, 0);
+  write_varint(layer, tile_extent);
+
+  std::string tile;
+  write_bytes(tile, 3, layer);
+  return tile;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// generate
+// all non-empty tiles from zoom 0 to max_z; tiles are enumerated from the polygon bounding boxes
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<tile_record> tile_source_t::generate(int max_z) const
+{
+  std::vector<tile_record> tiles;
+  if (max_z > max_zoom)
+  {
+    max_z = max_zoom;
+  }
+
+  for (int z = 0; z <= max_z; z++)
+  {
+    int count = 1 << z;
+    std::set<std::pair<int, int>> keys;
+    for (size_t idx_feature = 0; idx_feature < features.size(); idx_feature++)
+    {
+      const feature_t& feature = features[idx_feature];
+      for (size_t idx = 0; idx < feature.bboxes.size(); idx++)
+      {
+        const BoundingBox& b = feature.bboxes[idx];
+        int x0 = std::max(0, static_cast<int>(std::floor(b.min_x * count)));
+        int x1 = std::min(count - 1, static_cast<int>(std::floor(b.max_x * count)));
+        int y0 = std::max(0, static_cast<int>(std::floor(b.min_y * count)));
+        int y1 = std::min(count - 1, static_cast<int>(std::floor(b.max_y * count)));
+        for (int tx = x0; tx <= x1; tx++)
+        {
+          for (int ty = y0; ty <= y1; ty++)
+          {
+            keys.insert(std::make_pair(tx, ty));
+          }
+        }
+      }
+    }
+
+    size_t generated = 0;
+    for (std::set<std::pair<int, int>>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+    {
+      tile_record t;
+      t.z = z;
+      t.x = it->first;
+      t.y = it->second;
+      t.data = render(z, t.x, t.y);
+      if (!t.data.empty())
+      {
+        tiles.push_back(std::move(t));
+        generated++;
+      }
+    }
+    std::cout << "Zoom " << z << ": " << generated << " tiles" << std::endl;
+  }
+
+  return tiles;
+}
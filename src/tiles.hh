@@ -0,0 +1,76 @@
+#ifndef ELECTIONS_TILES_HH
+#define ELECTIONS_TILES_HH
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include "geometry.hh"
+#include "payload.hh"
+#include "data.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// lru_cache_t
+// bounded map from tile key to blob, least recently used entry evicted first
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class lru_cache_t
+{
+public:
+  lru_cache_t(size_t capacity);
+
+  std::shared_ptr<const blob_t> get(uint64_t key);
+  void put(uint64_t key, const std::shared_ptr<const blob_t>& blob);
+
+private:
+  typedef std::pair<uint64_t, std::shared_ptr<const blob_t>> entry_t;
+
+  size_t capacity;
+  std::mutex mutex;
+  std::list<entry_t> entries;
+  std::unordered_map<uint64_t, std::list<entry_t>::iterator> index;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// tile_source_t
+// Mapbox Vector Tiles (layer 'counties', extent 4096) clipped and simplified per zoom level;
+// tiles carry geometry and names only, per-year numbers are applied as feature state
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class tile_source_t
+{
+public:
+  static const int max_zoom = 14;
+
+  tile_source_t(std::vector<shape_t> shapes, const std::string& version, size_t capacity);
+
+  void preload(const std::vector<tile_record>& tiles);
+  std::shared_ptr<const blob_t> get(int z, int x, int y);
+  std::string render(int z, int x, int y) const;
+  std::vector<tile_record> generate(int max_z) const;
+
+private:
+  struct feature_t
+  {
+    uint64_t id;
+    size_t shape;
+    multipolygon_t mercator;            // unit square, y down
+    std::vector<BoundingBox> bboxes;    // per polygon
+  };
+
+  std::vector<shape_t> shapes;
+  std::vector<feature_t> features;
+  std::string version;
+  lru_cache_t cache;
+  std::unordered_map<uint64_t, std::shared_ptr<const blob_t>> pregenerated;
+
+  std::shared_ptr<const blob_t> make_blob(const std::string& data) const;
+};
+
+uint64_t tile_key(int z, int x, int y);
+Point2D to_mercator(const Point2D& p);
+bool parse_tile_path(const std::string& path, const std::string& suffix, int& z, int& x, int& y);
+
+#endif
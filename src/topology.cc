@@ -0,0 +1,510 @@
+#include "topology.hh"
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// geometry_levels
+// pixel size is about 360 / (512 * 2^zoom) degrees; tolerances are under half a pixel at max_zoom
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const geometry_level geometry_levels[] =
+{
+  { 0, 22, 0.0, 6 },
+  { 1, 7, 0.002, 4 },
+  { 2, 5, 0.008, 3 },
+  { 3, 3, 0.03, 2 }
+};
+
+const int geometry_level_count = sizeof(geometry_levels) / sizeof(geometry_levels[0]);
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// level_for_zoom
+// coarsest level whose max_zoom covers the zoom
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int level_for_zoom(int zoom)
+{
+  int level = 0;
+  for (int idx = 0; idx < geometry_level_count; idx++)
+  {
+    if (zoom <= geometry_levels[idx].max_zoom)
+    {
+      level = geometry_levels[idx].level;
+    }
+  }
+  return level;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// point and edge keys
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t point_key(const topo_point_t& p)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(p.x)) << 32) | static_cast<uint32_t>(p.y);
+}
+
+static bool point_less(const topo_point_t& a, const topo_point_t& b)
+{
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+static bool point_equal(const topo_point_t& a, const topo_point_t& b)
+{
+  return a.x == b.x && a.y == b.y;
+}
+
+struct edge_key_t
+{
+  uint64_t a;
+  uint64_t b;
+
+  bool operator==(const edge_key_t& other) const
+  {
+    return a == other.a && b == other.b;
+  }
+};
+
+struct edge_hash_t
+{
+  size_t operator()(const edge_key_t& key) const
+  {
+    return std::hash<uint64_t>()(key.a * 1099511628211ULL ^ key.b);
+  }
+};
+
+static edge_key_t edge_key(const topo_point_t& p, const topo_point_t& q)
+{
+  uint64_t a = point_key(p);
+  uint64_t b = point_key(q);
+  edge_key_t key;
+  key.a = a < b ? a : b;
+  key.b = a < b ? b : a;
+  return key;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// arc_index_t
+// deduplicates arcs; an arc and its reverse are the same arc
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct arc_index_t
+{
+  std::vector<arc_t>& arcs;
+  std::unordered_map<uint64_t, std::vector<int32_t>> index;
+
+  arc_index_t(std::vector<arc_t>& arcs_) : arcs(arcs_)
+  {
+  }
+
+  // canonical orientation: first point below last, or for loops second below second to last
+  static bool needs_reverse(const arc_t& arc)
+  {
+    const topo_point_t& first = arc.front();
+    const topo_point_t& last = arc.back();
+    if (point_equal(first, last))
+    {
+      return arc.size() > 2 && point_less(arc[arc.size() - 2], arc[1]);
+    }
+    return point_less(last, first);
+  }
+
+  static uint64_t hash(const arc_t& arc)
+  {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t idx = 0; idx < arc.size(); idx++)
+    {
+      h ^= point_key(arc[idx]);
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  int32_t add(arc_t& arc)
+  {
+    bool reversed = needs_reverse(arc);
+    if (reversed)
+    {
+      std::reverse(arc.begin(), arc.end());
+    }
+
+    uint64_t h = hash(arc);
+    std::vector<int32_t>& candidates = index[h];
+    for (size_t idx = 0; idx < candidates.size(); idx++)
+    {
+      const arc_t& other = arcs[candidates[idx]];
+      if (other.size() == arc.size() && std::equal(other.begin(), other.end(), arc.begin(), point_equal))
+      {
+        return reversed ? ~candidates[idx] : candidates[idx];
+      }
+    }
+
+    int32_t id = static_cast<int32_t>(arcs.size());
+    arcs.push_back(arc);
+    candidates.push_back(id);
+    return reversed ? ~id : id;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// build_topology
+// a ring vertex is a junction when the rings sharing the edge before it differ from the rings
+// sharing the edge after it; cutting every ring at its junctions yields identical arcs on
+// both sides of a shared border
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+topology_t build_topology(const std::vector<shape_t>& shapes, int quantization)
+{
+  topology_t topology;
+
+  if (shapes.empty())
+  {
+    return topology;
+  }
+
+  double max = std::numeric_limits<double>::max();
+  BoundingBox bbox(max, max, -max, -max);
+  for (size_t idx = 0; idx < shapes.size(); idx++)
+  {
+    BoundingBox b = bounding_box(shapes[idx].polygons);
+    if (b.min_x < bbox.min_x) bbox.min_x = b.min_x;
+    if (b.min_y < bbox.min_y) bbox.min_y = b.min_y;
+    if (b.max_x > bbox.max_x) bbox.max_x = b.max_x;
+    if (b.max_y > bbox.max_y) bbox.max_y = b.max_y;
+  }
+
+  topology.translate_x = bbox.min_x;
+  topology.translate_y = bbox.min_y;
+  topology.scale_x = (bbox.max_x > bbox.min_x) ? (bbox.max_x - bbox.min_x) / (quantization - 1) : 1.0;
+  topology.scale_y = (bbox.max_y > bbox.min_y) ? (bbox.max_y - bbox.min_y) / (quantization - 1) : 1.0;
+
+  // quantized open rings, in shape / polygon / ring order
+  std::vector<arc_t> rings;
+  for (size_t idx_shape = 0; idx_shape < shapes.size(); idx_shape++)
+  {
+    const multipolygon_t& polygons = shapes[idx_shape].polygons;
+    for (size_t idx_polygon = 0; idx_polygon < polygons.size(); idx_polygon++)
+    {
+      for (size_t idx_ring = 0; idx_ring < polygons[idx_polygon].size(); idx_ring++)
+      {
+        const ring_t& ring = polygons[idx_polygon][idx_ring];
+        arc_t points;
+        for (size_t idx = 0; idx < ring.size(); idx++)
+        {
+          topo_point_t p;
+          p.x = static_cast<int32_t>(std::lround((ring[idx].x - topology.translate_x) / topology.scale_x));
+          p.y = static_cast<int32_t>(std::lround((ring[idx].y - topology.translate_y) / topology.scale_y));
+          if (points.empty() || !point_equal(points.back(), p))
+          {
+            points.push_back(p);
+          }
+        }
+        while (points.size() > 1 && point_equal(points.front(), points.back()))
+        {
+          points.pop_back();
+        }
+        if (points.size() < 3)
+        {
+          points.clear();
+        }
+        rings.push_back(points);
+      }
+    }
+  }
+
+  // rings sharing each edge
+  std::unordered_map<edge_key_t, std::vector<uint32_t>, edge_hash_t> owners;
+  for (size_t idx_ring = 0; idx_ring < rings.size(); idx_ring++)
+  {
+    const arc_t& ring = rings[idx_ring];
+    for (size_t idx = 0; idx < ring.size(); idx++)
+    {
+      owners[edge_key(ring[idx], ring[(idx + 1) % ring.size()])].push_back(static_cast<uint32_t>(idx_ring));
+    }
+  }
+  for (std::unordered_map<edge_key_t, std::vector<uint32_t>, edge_hash_t>::iterator it = owners.begin(); it != owners.end(); ++it)
+  {
+    std::sort(it->second.begin(), it->second.end());
+  }
+
+  // cut rings into arcs
+  arc_index_t arc_index(topology.arcs);
+  std::vector<arc_ring_t> ring_arcs(rings.size());
+  for (size_t idx_ring = 0; idx_ring < rings.size(); idx_ring++)
+  {
+    const arc_t& ring = rings[idx_ring];
+    size_t n = ring.size();
+    if (n == 0)
+    {
+      continue;
+    }
+
+    std::vector<size_t> junctions;
+    for (size_t idx = 0; idx < n; idx++)
+    {
+      const std::vector<uint32_t>& before = owners[edge_key(ring[(idx + n - 1) % n], ring[idx])];
+      const std::vector<uint32_t>& after = owners[edge_key(ring[idx], ring[(idx + 1) % n])];
+      if (before != after)
+      {
+        junctions.push_back(idx);
+      }
+    }
+
+    if (junctions.empty())
+    {
+      // one closed arc, rotated to start at its smallest point
+      size_t start = 0;
+      for (size_t idx = 1; idx < n; idx++)
+      {
+        if (point_less(ring[idx], ring[start])) start = idx;
+      }
+      arc_t arc;
+      for (size_t idx = 0; idx <= n; idx++)
+      {
+        arc.push_back(ring[(start + idx) % n]);
+      }
+      ring_arcs[idx_ring].push_back(arc_index.add(arc));
+      continue;
+    }
+
+    for (size_t idx_junction = 0; idx_junction < junctions.size(); idx_junction++)
+    {
+      size_t from = junctions[idx_junction];
+      size_t to = junctions[(idx_junction + 1) % junctions.size()];
+      size_t length = (to + n - from) % n;
+      if (length == 0) length = n;
+      arc_t arc;
+      for (size_t idx = 0; idx <= length; idx++)
+      {
+        arc.push_back(ring[(from + idx) % n]);
+      }
+      ring_arcs[idx_ring].push_back(arc_index.add(arc));
+    }
+  }
+
+  // regroup by shape / polygon
+  size_t idx_flat = 0;
+  topology.geometries.resize(shapes.size());
+  for (size_t idx_shape = 0; idx_shape < shapes.size(); idx_shape++)
+  {
+    const multipolygon_t& polygons = shapes[idx_shape].polygons;
+    arc_geometry_t& geometry = topology.geometries[idx_shape];
+    for (size_t idx_polygon = 0; idx_polygon < polygons.size(); idx_polygon++)
+    {
+      arc_polygon_t polygon;
+      size_t first = idx_flat;
+      for (size_t idx_ring = 0; idx_ring < polygons[idx_polygon].size(); idx_ring++, idx_flat++)
+      {
+        // a degenerate exterior drops the polygon with its holes
+        if (ring_arcs[idx_flat].empty() || ring_arcs[first].empty())
+        {
+          continue;
+        }
+        polygon.push_back(ring_arcs[idx_flat]);
+      }
+      if (!polygon.empty())
+      {
+        geometry.push_back(polygon);
+      }
+    }
+  }
+
+  return topology;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// simplify_topology
+// Douglas-Peucker per arc in degrees; arc endpoints (junctions) are kept, so neighbours stay
+// joined
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+topology_t simplify_topology(const topology_t& topology, double tolerance)
+{
+  topology_t result = topology;
+  if (tolerance <= 0)
+  {
+    return result;
+  }
+
+  double tolerance2 = tolerance * tolerance;
+  double sx = topology.scale_x;
+  double sy = topology.scale_y;
+
+  for (size_t idx_arc = 0; idx_arc < result.arcs.size(); idx_arc++)
+  {
+    arc_t& arc = result.arcs[idx_arc];
+    size_t n = arc.size();
+    if (n <= 2)
+    {
+      continue;
+    }
+
+    std::vector<double> distance(n, 0.0);
+    std::vector<char> keep(n, 0);
+    keep[0] = 1;
+    keep[n - 1] = 1;
+
+    std::vector<std::pair<size_t, size_t>> stack;
+    stack.push_back(std::make_pair(static_cast<size_t>(0), n - 1));
+    while (!stack.empty())
+    {
+      size_t first = stack.back().first;
+      size_t last = stack.back().second;
+      stack.pop_back();
+
+      double ax = arc[first].x * sx, ay = arc[first].y * sy;
+      double dx = arc[last].x * sx - ax, dy = arc[last].y * sy - ay;
+      double len2 = dx * dx + dy * dy;
+
+      double max_dist = 0;
+      size_t index = 0;
+      for (size_t idx = first + 1; idx < last; idx++)
+      {
+        double px = arc[idx].x * sx - ax;
+        double py = arc[idx].y * sy - ay;
+        if (len2 > 0)
+        {
+          double t = (px * dx + py * dy) / len2;
+          if (t > 1) t = 1;
+          if (t > 0)
+          {
+            px -= t * dx;
+            py -= t * dy;
+          }
+        }
+        double dist = px * px + py * py;
+        distance[idx] = dist;
+        if (dist > max_dist)
+        {
+          max_dist = dist;
+          index = idx;
+        }
+      }
+
+      if (max_dist > tolerance2)
+      {
+        keep[index] = 1;
+        stack.push_back(std::make_pair(first, index));
+        stack.push_back(std::make_pair(index, last));
+      }
+    }
+
+    // keep one interior point per arc, two for loops, so small rings do not collapse
+    size_t min_kept = point_equal(arc[0], arc[n - 1]) ? 2 : 1;
+    if (n - 2 >= min_kept)
+    {
+      size_t kept = 0;
+      for (size_t idx = 1; idx + 1 < n; idx++)
+      {
+        if (keep[idx]) kept++;
+      }
+      while (kept < min_kept)
+      {
+        size_t best = 0;
+        for (size_t idx = 1; idx + 1 < n; idx++)
+        {
+          if (!keep[idx] && (best == 0 || distance[idx] > distance[best])) best = idx;
+        }
+        if (best == 0) break;
+        keep[best] = 1;
+        kept++;
+      }
+    }
+
+    size_t count = 0;
+    for (size_t idx = 0; idx < n; idx++)
+    {
+      if (keep[idx]) arc[count++] = arc[idx];
+    }
+    arc.resize(count);
+  }
+
+  return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// topology_polygons
+// reassemble one geometry in degrees, rounded to decimals; degenerate rings are dropped and a
+// polygon whose exterior collapses is dropped with its holes
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+multipolygon_t topology_polygons(const topology_t& topology, size_t index, int decimals)
+{
+  multipolygon_t polygons;
+  if (index >= topology.geometries.size())
+  {
+    return polygons;
+  }
+
+  double factor = std::pow(10.0, decimals);
+  const arc_geometry_t& geometry = topology.geometries[index];
+  for (size_t idx_polygon = 0; idx_polygon < geometry.size(); idx_polygon++)
+  {
+    polygon_t polygon;
+    for (size_t idx_ring = 0; idx_ring < geometry[idx_polygon].size(); idx_ring++)
+    {
+      const arc_ring_t& refs = geometry[idx_polygon][idx_ring];
+      ring_t ring;
+      for (size_t idx_ref = 0; idx_ref < refs.size(); idx_ref++)
+      {
+        int32_t ref = refs[idx_ref];
+        const arc_t& arc = topology.arcs[ref < 0 ? ~ref : ref];
+        for (size_t idx = 0; idx < arc.size(); idx++)
+        {
+          const topo_point_t& q = arc[ref < 0 ? arc.size() - 1 - idx : idx];
+          double x = std::round((q.x * topology.scale_x + topology.translate_x) * factor) / factor;
+          double y = std::round((q.y * topology.scale_y + topology.translate_y) * factor) / factor;
+          if (ring.empty() || ring.back().x != x || ring.back().y != y)
+          {
+            ring.push_back(Point2D(x, y));
+          }
+        }
+      }
+
+      if (ring.size() > 1 && ring.front().x == ring.back().x && ring.front().y == ring.back().y)
+      {
+        ring.pop_back();
+      }
+
+      double area = 0;
+      for (size_t idx = 0; idx < ring.size(); idx++)
+      {
+        const Point2D& a = ring[idx];
+        const Point2D& b = ring[(idx + 1) % ring.size()];
+        area += a.x * b.y - b.x * a.y;
+      }
+
+      if (ring.size() < 3 || area == 0)
+      {
+        if (idx_ring == 0) break;
+        continue;
+      }
+
+      ring.push_back(ring.front());
+      polygon.push_back(ring);
+    }
+
+    if (!polygon.empty())
+    {
+      polygons.push_back(polygon);
+    }
+  }
+
+  return polygons;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// count_arc_points
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+size_t count_arc_points(const topology_t& topology)
+{
+  size_t count = 0;
+  for (size_t idx = 0; idx < topology.arcs.size(); idx++)
+  {
+    count += topology.arcs[idx].size();
+  }
+  return count;
+}
@@ -0,0 +1,60 @@
+#ifndef ELECTIONS_TOPOLOGY_HH
+#define ELECTIONS_TOPOLOGY_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "geometry.hh"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// geometry_level
+// precomputed simplification levels; level 0 is the source geometry. A level is used for
+// zooms up to max_zoom; tolerance is in degrees, decimals is the coordinate quantization
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct geometry_level
+{
+  int level;
+  int max_zoom;
+  double tolerance;
+  int decimals;
+};
+
+extern const geometry_level geometry_levels[];
+extern const int geometry_level_count;
+
+int level_for_zoom(int zoom);
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// topology_t
+// shared borders stored once as arcs of quantized points; rings reference arcs by index,
+// ~index (negative) when traversed in reverse, as in TopoJSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct topo_point_t
+{
+  int32_t x;
+  int32_t y;
+};
+
+typedef std::vector<topo_point_t> arc_t;
+typedef std::vector<int32_t> arc_ring_t;
+typedef std::vector<arc_ring_t> arc_polygon_t;
+typedef std::vector<arc_polygon_t> arc_geometry_t;
+
+struct topology_t
+{
+  double scale_x = 1.0;
+  double scale_y = 1.0;
+  double translate_x = 0.0;
+  double translate_y = 0.0;
+  std::vector<arc_t> arcs;
+  std::vector<arc_geometry_t> geometries;  // parallel to the input shapes
+};
+
+topology_t build_topology(const std::vector<shape_t>& shapes, int quantization);
+topology_t simplify_topology(const topology_t& topology, double tolerance);
+multipolygon_t topology_polygons(const topology_t& topology, size_t index, int decimals);
+size_t count_arc_points(const topology_t& topology);
+
+#endif